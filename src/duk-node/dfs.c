@@ -7,10 +7,14 @@ Implementation notes:
 
 * access(2) is discouraged in the POSIX man page so I might not implement fs.access 
 * fs.exists is deprecated so I probably won't implement it
+* the async functions run on the thread pool of the event loop (see dloop.c)
+* readFileSync(path, { mmap: true }) returns a Buffer backed by a private mapping
+  of the file instead of a copy (see dukmmap.h)
 
 */
 
 #include "duknode.h"
+#include "../dukplus/dukmmap.h"
 
 /*
 ------------------------------------------------------------------------------------
@@ -114,10 +118,53 @@ static const duk_function_list_entry dfs_stats_methods[] = {
 ------------------------------------------------------------------------------------
 */
 
-static int dfs_make_file_array(duk_context *ctx, const char *path) {
-	int i = 0;
+/* list of file names collected without touching the Duktape heap */
+typedef struct {
+	char **names;
+	int count;
+	int capacity;
+} dfs_names;
+
+static int dfs_names_add(dfs_names *list, const char *name) {
+	if (list->count == list->capacity) {
+		int capacity = list->capacity ? list->capacity * 2 : 16;
+		char **names = realloc(list->names, capacity * sizeof(char*));
+		if (names == NULL) {
+			return -1;
+		}
+		list->names = names;
+		list->capacity = capacity;
+	}
+
+	list->names[list->count] = strdup(name);
+	if (list->names[list->count] == NULL) {
+		return -1;
+	}
+	list->count++;
+	return 0;
+}
+
+static void dfs_names_free(dfs_names *list) {
+	int i;
+	for (i = 0; i < list->count; i++) {
+		free(list->names[i]);
+	}
+	free(list->names);
+	memset(list, 0, sizeof(dfs_names));
+}
+
+static void dfs_push_names(duk_context *ctx, dfs_names *list) {
+	int i;
 	duk_idx_t arr_idx = duk_push_array(ctx);
 
+	for (i = 0; i < list->count; i++) {
+		duk_push_string(ctx, list->names[i]);
+		duk_put_prop_index(ctx, arr_idx, i);
+	}
+}
+
+/* safe to call from worker threads */
+static int dfs_list_dir(const char *path, dfs_names *list) {
 #if DUKNODE_PLATFORM_WINDOWS
 	WIN32_FIND_DATA ffd;
 	HANDLE hFind = INVALID_HANDLE_VALUE;
@@ -137,16 +184,19 @@ static int dfs_make_file_array(duk_context *ctx, const char *path) {
 			continue;
 		}
 
-		duk_push_string(ctx, ffd.cFileName);
-		duk_put_prop_index(ctx, arr_idx, i++);
+		if (dfs_names_add(list, ffd.cFileName)) {
+			FindClose(hFind);
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			return -1;
+		}
 	} while (FindNextFile(hFind, &ffd) != 0);
 
 	dwError = GetLastError();
+	FindClose(hFind);
 	if (dwError != ERROR_NO_MORE_FILES) {
+		SetLastError(dwError);
 		return -1;
 	}
-
-	FindClose(hFind);
 #else
 	DIR *dirp;
 	struct dirent *dp;
@@ -161,8 +211,11 @@ static int dfs_make_file_array(duk_context *ctx, const char *path) {
 				continue;
 			}
 
-			duk_push_string(ctx, dp->d_name);
-			duk_put_prop_index(ctx, arr_idx, i++);
+			if (dfs_names_add(list, dp->d_name)) {
+				(void) closedir(dirp);
+				errno = ENOMEM;
+				return -1;
+			}
 		}
 	} while (dp != NULL);
 
@@ -172,44 +225,20 @@ static int dfs_make_file_array(duk_context *ctx, const char *path) {
 	return 0;
 }
 
-/*
-------------------------------------------------------------------------------------
-*/
-
-static duk_ret_t dfs_rename(duk_context *ctx) {
-	const char *oldPath = duk_require_string(ctx, 0);
-	const char *newPath = duk_require_string(ctx, 1);
+static int dfs_make_file_array(duk_context *ctx, const char *path) {
+	dfs_names list;
+	memset(&list, 0, sizeof(dfs_names));
 
-	if (!duk_is_function(ctx, 2)) {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as third argument");
+	if (dfs_list_dir(path, &list)) {
+		dfs_names_free(&list);
 		return -1;
 	}
-	duk_dup(ctx, 2);
 
-	if (rename(oldPath, newPath)) {
-		// duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not rename %s to %s", oldPath, newPath);
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not rename %s to %s: %s", oldPath, newPath, strerror(errno));
-	} else {
-		duk_push_null(ctx);
-	}
-
-	duk_call(ctx, 1);
+	dfs_push_names(ctx, &list);
+	dfs_names_free(&list);
 	return 0;
 }
 
-static duk_ret_t dfs_rename_sync(duk_context *ctx) {
-	const char *oldPath = duk_require_string(ctx, 0);
-	const char *newPath = duk_require_string(ctx, 1);
-
-	if (rename(oldPath, newPath)) {
-		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not rename %s to %s: %s", oldPath, newPath, strerror(errno));
-		return -1;
-	}
-
-	duk_push_undefined(ctx);
-	return 1;
-}
-
 static void dfs_push_stat(duk_context *ctx, struct stat *buf) {
 	duk_push_object(ctx);
 
@@ -250,26 +279,298 @@ static void dfs_push_stat(duk_context *ctx, struct stat *buf) {
 	duk_set_prototype(ctx, -2);
 }
 
-static duk_ret_t dfs_stat(duk_context *ctx) {
-	struct stat buf;
-	const char *path = duk_require_string(ctx, 0);
+/*
+------------------------------------------------------------------------------------
+Asynchronous requests
+
+The async functions copy their arguments into a dfs_req, run the syscall
+on the event loop's thread pool and call the callback from dfs_req_done.
+*/
+
+enum {
+	DFS_OP_RENAME,
+	DFS_OP_STAT,
+	DFS_OP_LSTAT,
+	DFS_OP_REALPATH,
+	DFS_OP_REMOVE,
+	DFS_OP_MKDIR,
+	DFS_OP_READDIR,
+	DFS_OP_READFILE,
+	DFS_OP_WRITEFILE,
+	DFS_OP_APPENDFILE
+};
 
-	if (!duk_is_function(ctx, 1)) {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as second argument");
+typedef struct {
+	int op;
+	char *path;
+	char *path2;      /* new path for rename */
+	char *data;       /* file contents or resolved path */
+	size_t size;
+	struct stat st;
+	dfs_names names;
+	int err;          /* errno (GetLastError for Windows API calls), 0 on success */
+} dfs_req;
+
+static int dfs_read_whole_file(dfs_req *req) {
+	FILE *inputf = fopen(req->path, "rb");
+	if (inputf == NULL) {
 		return -1;
 	}
-	duk_dup(ctx, 1);
 
-	int result = stat(path, &buf);
+	fseek(inputf, 0, SEEK_END);
+	long size = ftell(inputf);
+	fseek(inputf, 0, SEEK_SET);
+
+	req->data = malloc(size > 0 ? size : 1);
+	if (req->data == NULL) {
+		fclose(inputf);
+		errno = ENOMEM;
+		return -1;
+	}
+	req->size = fread(req->data, 1, size, inputf);
+	fclose(inputf);
+
+	return 0;
+}
+
+static int dfs_write_whole_file(dfs_req *req, const char *mode) {
+	FILE *outputf = fopen(req->path, mode);
+	if (outputf == NULL) {
+		return -1;
+	}
+
+	if (req->size > 0 && fwrite(req->data, 1, req->size, outputf) != req->size) {
+		int err = errno;
+		fclose(outputf);
+		errno = err;
+		return -1;
+	}
+
+	return fclose(outputf);
+}
+
+static int dfs_resolve_path(dfs_req *req) {
+#if DUKNODE_PLATFORM_WINDOWS
+	req->data = malloc(DUKNODE_MAX_PATH);
+	if (req->data == NULL) {
+		SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		return -1;
+	}
+	return GetFullPathName(req->path, DUKNODE_MAX_PATH, req->data, NULL) == 0 ? -1 : 0;
+#else
+	req->data = malloc(PATH_MAX+1);
+	if (req->data == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	return realpath(req->path, req->data) == NULL ? -1 : 0;
+#endif
+}
+
+/* runs on a worker thread */
+static void dfs_req_work(void *data) {
+	dfs_req *req = data;
+	int result = 0;
+
+	switch (req->op) {
+	case DFS_OP_RENAME: result = rename(req->path, req->path2); break;
+	case DFS_OP_STAT: result = stat(req->path, &req->st); break;
+	case DFS_OP_LSTAT: result = lstat(req->path, &req->st); break;
+	case DFS_OP_REALPATH: result = dfs_resolve_path(req); break;
+	case DFS_OP_REMOVE: result = remove(req->path); break;
+	case DFS_OP_MKDIR: result = mkdir(req->path, 0777); break;
+	case DFS_OP_READDIR: result = dfs_list_dir(req->path, &req->names); break;
+	case DFS_OP_READFILE: result = dfs_read_whole_file(req); break;
+	case DFS_OP_WRITEFILE: result = dfs_write_whole_file(req, "wb"); break;
+	case DFS_OP_APPENDFILE: result = dfs_write_whole_file(req, "ab"); break;
+	}
+
 	if (result != 0) {
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not get file information for %s: %s", path, strerror(errno));
-		duk_push_null(ctx);
+#if DUKNODE_PLATFORM_WINDOWS
+		if (req->op == DFS_OP_REALPATH || req->op == DFS_OP_READDIR) {
+			req->err = (int) GetLastError();
+		} else {
+			req->err = errno;
+		}
+#else
+		req->err = errno;
+#endif
+		if (req->err == 0) {
+			req->err = EIO;
+		}
+	}
+}
+
+static void dfs_push_req_error(duk_context *ctx, dfs_req *req) {
+	const char *what;
+
+	switch (req->op) {
+	case DFS_OP_RENAME:
+		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not rename %s to %s: %s", req->path, req->path2, strerror(req->err));
+		return;
+	case DFS_OP_STAT:
+	case DFS_OP_LSTAT: what = "could not get file information for"; break;
+	case DFS_OP_REALPATH: what = "could not get realpath for"; break;
+	case DFS_OP_REMOVE: what = "could not remove"; break;
+	case DFS_OP_MKDIR: what = "could not create directory"; break;
+	case DFS_OP_READDIR: what = "could not read directory"; break;
+	default: what = "could not open file"; break;
+	}
+
+#if DUKNODE_PLATFORM_WINDOWS
+	if (req->op == DFS_OP_REALPATH || req->op == DFS_OP_READDIR) {
+		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "%s %s: error code %d", what, req->path, req->err);
+		return;
+	}
+#endif
+
+	duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "%s %s: %s", what, req->path, strerror(req->err));
+}
+
+/* runs on the event loop thread; pushes the callback arguments */
+static duk_idx_t dfs_req_done(duk_context *ctx, void *data) {
+	dfs_req *req = data;
+	duk_idx_t nargs = 1;
+
+	if (req->err) {
+		dfs_push_req_error(ctx, req);
 	} else {
 		duk_push_null(ctx);
-		dfs_push_stat(ctx, &buf);
 	}
 
-	duk_call(ctx, 2);
+	switch (req->op) {
+	case DFS_OP_STAT:
+	case DFS_OP_LSTAT:
+		if (req->err) {
+			duk_push_null(ctx);
+		} else {
+			dfs_push_stat(ctx, &req->st);
+		}
+		nargs = 2;
+		break;
+	case DFS_OP_REALPATH:
+		if (req->err) {
+			duk_push_null(ctx);
+		} else {
+			duk_push_string(ctx, req->data);
+		}
+		nargs = 2;
+		break;
+	case DFS_OP_READDIR:
+		if (req->err) {
+			duk_push_null(ctx);
+		} else {
+			dfs_push_names(ctx, &req->names);
+		}
+		nargs = 2;
+		break;
+	case DFS_OP_READFILE:
+		if (req->err) {
+			duk_push_null(ctx);
+		} else {
+			void *bytes = duk_push_fixed_buffer(ctx, req->size);
+			memcpy(bytes, req->data, req->size);
+		}
+		nargs = 2;
+		break;
+	}
+
+	dfs_names_free(&req->names);
+	free(req->path);
+	free(req->path2);
+	free(req->data);
+	free(req);
+
+	return nargs;
+}
+
+/* creates a request for path at index 0, checks the callback at cb_index */
+static dfs_req *dfs_req_new(duk_context *ctx, int op, duk_idx_t cb_index, const char *ordinal) {
+	const char *path = duk_require_string(ctx, 0);
+	dfs_req *req;
+
+	if (!duk_is_function(ctx, cb_index)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as %s argument", ordinal);
+		return NULL;
+	}
+
+	req = calloc(1, sizeof(dfs_req));
+	if (req == NULL || (req->path = strdup(path)) == NULL) {
+		free(req);
+		duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not allocate request for %s", path);
+		return NULL;
+	}
+
+	req->op = op;
+	return req;
+}
+
+/* gets the string or buffer at index */
+static const void *dfs_require_data(duk_context *ctx, duk_idx_t index, duk_size_t *sz) {
+	if (duk_is_buffer(ctx, index) || duk_is_object(ctx, index)) {
+		return duk_require_buffer_data(ctx, index, sz);
+	} else if (duk_is_string(ctx, index)) {
+		return duk_get_lstring(ctx, index, sz);
+	}
+
+	duk_error(ctx, DUK_ERR_TYPE_ERROR, "string or buffer expected as second argument");
+	return NULL;
+}
+
+static dfs_req *dfs_req_new_write(duk_context *ctx, int op) {
+	duk_size_t sz;
+	const void *src = dfs_require_data(ctx, 1, &sz);
+	dfs_req *req = dfs_req_new(ctx, op, 2, "third");
+
+	req->data = malloc(sz > 0 ? sz : 1);
+	if (req->data == NULL) {
+		free(req->path);
+		free(req);
+		duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not allocate %lu bytes", (unsigned long) sz);
+		return NULL;
+	}
+	memcpy(req->data, src, sz);
+	req->size = sz;
+
+	return req;
+}
+
+/*
+------------------------------------------------------------------------------------
+*/
+
+static duk_ret_t dfs_rename(duk_context *ctx) {
+	const char *newPath = duk_require_string(ctx, 1);
+	dfs_req *req = dfs_req_new(ctx, DFS_OP_RENAME, 2, "third");
+
+	req->path2 = strdup(newPath);
+	if (req->path2 == NULL) {
+		free(req->path);
+		free(req);
+		duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not allocate request for %s", newPath);
+		return -1;
+	}
+
+	dloop_queue_work(ctx, 2, dfs_req_work, dfs_req_done, req);
+	return 0;
+}
+
+static duk_ret_t dfs_rename_sync(duk_context *ctx) {
+	const char *oldPath = duk_require_string(ctx, 0);
+	const char *newPath = duk_require_string(ctx, 1);
+
+	if (rename(oldPath, newPath)) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not rename %s to %s: %s", oldPath, newPath, strerror(errno));
+		return -1;
+	}
+
+	duk_push_undefined(ctx);
+	return 1;
+}
+
+static duk_ret_t dfs_stat(duk_context *ctx) {
+	dfs_req *req = dfs_req_new(ctx, DFS_OP_STAT, 1, "second");
+	dloop_queue_work(ctx, 1, dfs_req_work, dfs_req_done, req);
 	return 0;
 }
 
@@ -288,25 +589,8 @@ static duk_ret_t dfs_stat_sync(duk_context *ctx) {
 }
 
 static duk_ret_t dfs_lstat(duk_context *ctx) {
-	struct stat buf;
-	const char *path = duk_require_string(ctx, 0);
-
-	if (!duk_is_function(ctx, 1)) {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as second argument");
-		return -1;
-	}
-	duk_dup(ctx, 1);
-
-	int result = lstat(path, &buf);
-	if (result != 0) {
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not get file information for %s: %s", path, strerror(errno));
-		duk_push_null(ctx);
-	} else {
-		duk_push_null(ctx);
-		dfs_push_stat(ctx, &buf);
-	}
-
-	duk_call(ctx, 2);
+	dfs_req *req = dfs_req_new(ctx, DFS_OP_LSTAT, 1, "second");
+	dloop_queue_work(ctx, 1, dfs_req_work, dfs_req_done, req);
 	return 0;
 }
 
@@ -325,42 +609,8 @@ static duk_ret_t dfs_lstat_sync(duk_context *ctx) {
 }
 
 static duk_ret_t dfs_realpath(duk_context *ctx) {
-	const char *path = duk_require_string(ctx, 0);
-
-	if (!duk_is_function(ctx, 1)) {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as second argument");
-		return -1;
-	}
-	duk_dup(ctx, 1);
-
-#if DUKNODE_PLATFORM_WINDOWS 
-	char fullpath[DUKNODE_MAX_PATH];
-	DWORD retval = 0;
-
-	retval = GetFullPathName(path, DUKNODE_MAX_PATH, fullpath, NULL);
-
-	if (retval == 0) {
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not get realpath for %s: %s", path, GetLastError());
-		duk_push_null(ctx);
-	} else {
-		duk_push_null(ctx);
-		duk_push_string(ctx, fullpath);
-	}
-#else
-	char fullpath[PATH_MAX+1];
-
-	char *res = realpath(path, fullpath);
-
-	if (res == NULL) {
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not get realpath for %s: %s", path, strerror(errno));
-		duk_push_null(ctx);
-	} else {
-		duk_push_null(ctx);
-		duk_push_string(ctx, fullpath);
-	}
-#endif
-
-	duk_call(ctx, 2);
+	dfs_req *req = dfs_req_new(ctx, DFS_OP_REALPATH, 1, "second");
+	dloop_queue_work(ctx, 1, dfs_req_work, dfs_req_done, req);
 	return 0;
 }
 
@@ -393,21 +643,8 @@ static duk_ret_t dfs_realpath_sync(duk_context *ctx) {
 }
 
 static duk_ret_t dfs_remove(duk_context *ctx) {
-	const char *path = duk_require_string(ctx, 0);
-
-	if (!duk_is_function(ctx, 1)) {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as second argument");
-		return -1;
-	}
-	duk_dup(ctx, 1);
-
-	if (remove(path)) {
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not remove %s: %s", path, strerror(errno));
-	} else {
-		duk_push_null(ctx);
-	}
-
-	duk_call(ctx, 1);
+	dfs_req *req = dfs_req_new(ctx, DFS_OP_REMOVE, 1, "second");
+	dloop_queue_work(ctx, 1, dfs_req_work, dfs_req_done, req);
 	return 0;
 }
 
@@ -424,21 +661,8 @@ static duk_ret_t dfs_remove_sync(duk_context *ctx) {
 }
 
 static duk_ret_t dfs_mkdir(duk_context *ctx) {
-	const char *path = duk_require_string(ctx, 0);
-
-	if (!duk_is_function(ctx, 1)) {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as second argument");
-		return -1;
-	}
-	duk_dup(ctx, 1);
-
-	if (mkdir(path, 0777)) {
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not create directory %s: %s", path, strerror(errno));
-	} else {
-		duk_push_null(ctx);
-	}
-
-	duk_call(ctx, 1);
+	dfs_req *req = dfs_req_new(ctx, DFS_OP_MKDIR, 1, "second");
+	dloop_queue_work(ctx, 1, dfs_req_work, dfs_req_done, req);
 	return 0;
 }
 
@@ -454,28 +678,9 @@ static duk_ret_t dfs_mkdir_sync(duk_context *ctx) {
 	return 1;
 }
 
-// dfs_make_file_array
 static duk_ret_t dfs_readdir(duk_context *ctx) {
-	const char *path = duk_require_string(ctx, 0);
-
-	if (!duk_is_function(ctx, 1)) {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as second argument");
-		return -1;
-	}
-	duk_dup(ctx, 1);
-
-	duk_push_null(ctx); /* pre-emptively push null in case we succeed */
-	if (dfs_make_file_array(ctx, path)) {
-		duk_pop_2(ctx); /* pop null and array */
-#if DUKNODE_PLATFORM_WINDOWS
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not read directory %s: %s", path, GetLastError());
-#else
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not read directory %s: %s", path, strerror(errno));
-#endif
-		duk_push_null(ctx);
-	}
-
-	duk_call(ctx, 2);
+	dfs_req *req = dfs_req_new(ctx, DFS_OP_READDIR, 1, "second");
+	dloop_queue_work(ctx, 1, dfs_req_work, dfs_req_done, req);
 	return 0;
 }
 
@@ -495,40 +700,39 @@ static duk_ret_t dfs_readdir_sync(duk_context *ctx) {
 }
 
 static duk_ret_t dfs_readfile(duk_context *ctx) {
-	const char *filename = duk_require_string(ctx, 0);
-	FILE *inputf = NULL;
+	dfs_req *req = dfs_req_new(ctx, DFS_OP_READFILE, 1, "second");
+	dloop_queue_work(ctx, 1, dfs_req_work, dfs_req_done, req);
+	return 0;
+}
 
-	if (!duk_is_function(ctx, 1)) {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as second argument");
-		return -1;
-	}
-	duk_dup(ctx, 1);
+static int dfs_option_mmap(duk_context *ctx, duk_idx_t index) {
+	int result = 0;
 
-	duk_push_null(ctx); /* pre-emptively push null in case we succeed */
-	inputf = fopen(filename, "rb");
-	if (inputf == NULL) {
+	if (duk_is_object(ctx, index)) {
+		duk_get_prop_string(ctx, index, "mmap");
+		result = duk_to_boolean(ctx, -1);
 		duk_pop(ctx);
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not open file %s: %s", filename, strerror(errno));
-		duk_push_null(ctx);
-		duk_call(ctx, 2);
-		return 0;
 	}
 
-	fseek(inputf, 0, SEEK_END);
-	long size = ftell(inputf);
-	fseek(inputf, 0, SEEK_SET);
-	void *bytes = duk_push_fixed_buffer(ctx, size);
-	fread(bytes, 1, size, inputf);
-	fclose(inputf);
-
-	duk_call(ctx, 2);
-	return 0;
+	return result;
 }
 
 static duk_ret_t dfs_readfile_sync(duk_context *ctx) {
 	const char *filename = duk_require_string(ctx, 0);
 	FILE *inputf = NULL;
 
+	if (dfs_option_mmap(ctx, 1)) {
+		void *ptr; size_t len;
+
+		if (dukmmap_map(filename, &ptr, &len)) {
+			duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not map file %s: %s", filename, strerror(errno));
+			return -1;
+		}
+
+		dukmmap_push_buffer(ctx, ptr, len);
+		return 1;
+	}
+
 	inputf = fopen(filename, "rb");
 	if (inputf == NULL) {
 		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not open file %s: %s", filename, strerror(errno));
@@ -546,40 +750,8 @@ static duk_ret_t dfs_readfile_sync(duk_context *ctx) {
 }
 
 static duk_ret_t dfs_writefile(duk_context *ctx) {
-	const char *filename = duk_require_string(ctx, 0);
-	FILE *outputf = NULL;
-
-	if (!duk_is_function(ctx, 2)) {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as third argument");
-		return -1;
-	}
-	duk_dup(ctx, 2);
-
-	outputf = fopen(filename, "wb");
-	if (outputf == NULL) {
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not open file %s: %s", filename, strerror(errno));
-		duk_call(ctx, 1);
-		return 0;
-	}
-
-	if (duk_is_buffer(ctx, 1) || duk_is_object(ctx, 1)) {
-		
-		void *buffer; duk_size_t sz;
-		buffer = duk_require_buffer_data(ctx, 1, &sz);
-		fwrite(buffer, 1, sz, outputf);
-
-	} else if (duk_is_string(ctx, 1)) {
-
-		const char *outputs = duk_get_string(ctx, 1);
-		fputs(outputs, outputf);
-
-	} else {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "string or buffer expected as second argument");
-		return -1;
-	}
-
-	duk_push_null(ctx);
-	duk_call(ctx, 1);
+	dfs_req *req = dfs_req_new_write(ctx, DFS_OP_WRITEFILE);
+	dloop_queue_work(ctx, 2, dfs_req_work, dfs_req_done, req);
 	return 0;
 }
 
@@ -614,40 +786,8 @@ static duk_ret_t dfs_writefile_sync(duk_context *ctx) {
 }
 
 static duk_ret_t dfs_appendfile(duk_context *ctx) {
-	const char *filename = duk_require_string(ctx, 0);
-	FILE *outputf = NULL;
-
-	if (!duk_is_function(ctx, 2)) {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as third argument");
-		return -1;
-	}
-	duk_dup(ctx, 2);
-
-	outputf = fopen(filename, "ab");
-	if (outputf == NULL) {
-		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not open file %s: %s", filename, strerror(errno));
-		duk_call(ctx, 1);
-		return 0;
-	}
-
-	if (duk_is_buffer(ctx, 1) || duk_is_object(ctx, 1)) {
-		
-		void *buffer; duk_size_t sz;
-		buffer = duk_require_buffer_data(ctx, 1, &sz);
-		fwrite(buffer, 1, sz, outputf);
-
-	} else if (duk_is_string(ctx, 1)) {
-
-		const char *outputs = duk_get_string(ctx, 1);
-		fputs(outputs, outputf);
-
-	} else {
-		duk_error(ctx, DUK_ERR_TYPE_ERROR, "string or buffer expected as second argument");
-		return -1;
-	}
-
-	duk_push_null(ctx);
-	duk_call(ctx, 1);
+	dfs_req *req = dfs_req_new_write(ctx, DFS_OP_APPENDFILE);
+	dloop_queue_work(ctx, 2, dfs_req_work, dfs_req_done, req);
 	return 0;
 }
 
@@ -692,6 +832,16 @@ static duk_ret_t dfs_create_read_stream(duk_context *ctx) {
 	}
 
 	push_difstream(ctx, inputf);
+
+	if (duk_is_object(ctx, 1)) {
+		duk_get_prop_string(ctx, 1, "highWaterMark");
+		if (duk_is_number(ctx, -1) && duk_get_int(ctx, -1) > 0) {
+			duk_put_prop_string(ctx, -2, "highWaterMark");
+		} else {
+			duk_pop(ctx);
+		}
+	}
+
 	return 1;
 }
 
@@ -731,12 +881,12 @@ static const duk_function_list_entry dfs_module[] = {
 	{ "readdir", dfs_readdir, 2 },
 	{ "readdirSync", dfs_readdir_sync, 1 },
 	{ "readFile", dfs_readfile, 2 },
-	{ "readFileSync", dfs_readfile_sync, 1 },
+	{ "readFileSync", dfs_readfile_sync, 2 },
 	{ "writeFile", dfs_writefile, 3 },
 	{ "writeFileSync", dfs_writefile_sync, 2 },
 	{ "appendFile", dfs_appendfile, 3 },
 	{ "appendFileSync", dfs_appendfile_sync, 2 },
-	{ "createReadStream", dfs_create_read_stream, 1 },
+	{ "createReadStream", dfs_create_read_stream, 2 },
 	{ "createWriteStream", dfs_create_write_stream, 1 },
 	{ NULL, NULL, 0}
 };
@@ -2,9 +2,26 @@
 File Stream object for Duktape.
 Implements a subset of the Stream object of Node.js
 see: https://nodejs.org/api/stream.html
+
+Implementation notes:
+
+* readable streams deliver highWaterMark-sized chunks through 'data'/'end'
+  events; the next chunk is read on the event loop's thread pool while the
+  current one is handled, and pause/resume stop and restart reading
+* chunks are read into a small pool of reusable C buffers before being
+  copied to the heap; readInto(buffer) reads synchronously into a buffer
+  owned by the script, for loops that want no allocation per chunk
+* readLines([max]) and forEachLine(callback) read lines synchronously in
+  large blocks (see dukplus/duklines.h)
+* pipe honours write() returning false and waits for 'drain'; file write
+  streams write synchronously and always return true
+* writev(chunks) writes an array of strings and buffers with one writev
+  call (stdio on Windows) instead of one write per chunk
+* the event and flow logic is written in JavaScript (see _dfstream_src)
 */
 
 #include "duknode.h"
+#include "../dukplus/duklines.h"
 
 
 /*
@@ -17,6 +34,11 @@ see: https://nodejs.org/api/stream.html
 #define DIFSTREAM_PROTOTYPE "FileStreamReadablePrototype"
 #define DOFSTREAM_PROTOTYPE "FileStreamWritablePrototype"
 
+/* default chunk size of readable streams (same as Node.js fs streams) */
+#define DFSTREAM_HIGH_WATER_MARK (64 * 1024)
+/* maximum number of idle read buffers kept for reuse */
+#define DFSTREAM_POOL_MAX 8
+
 /*
 ------------------------------------------------------------------------------------
 */
@@ -44,6 +66,16 @@ static FILE* dfstream_file_from_this(duk_context *ctx) {
 	return f;
 }
 
+/* file of 'this' for byte-oriented operations (gives back line read-ahead) */
+static FILE* dfstream_file_for_bytes(duk_context *ctx) {
+	FILE *f;
+	duk_push_this(ctx);
+	f = dfstream_require_file(ctx, -1);
+	duklines_sync_object(ctx, -1, f);
+	duk_pop(ctx);
+	return f;
+}
+
 /*
 ------------------------------------------------------------------------------------
 */
@@ -55,6 +87,9 @@ void push_difstream(duk_context *ctx, FILE *inputf) {
 
 	duk_push_pointer(ctx, inputf);
 	duk_put_prop_string(ctx, -2, DFSTREAM_HANDLE_PROP);
+
+	duk_push_int(ctx, DFSTREAM_HIGH_WATER_MARK);
+	duk_put_prop_string(ctx, -2, "highWaterMark");
 }
 
 void push_dofstream(duk_context *ctx, FILE *outputf) {
@@ -67,8 +102,135 @@ void push_dofstream(duk_context *ctx, FILE *outputf) {
 }
 
 static duk_ret_t dfstream_finalizer(duk_context *ctx) {
-	FILE *f = dfstream_require_file(ctx, 0);
-	fclose(f);
+	FILE *f;
+
+	duklines_free(ctx, 0);
+
+	duk_get_prop_string(ctx, 0, DFSTREAM_HANDLE_PROP);
+	f = duk_get_pointer(ctx, -1);
+	duk_pop(ctx);
+
+	/* NULL if the stream was ended; like _close, leave the standard streams open */
+	if (f == stdin || f == stdout || f == stderr) {
+		fflush(f);
+	} else if (f) {
+		fclose(f);
+	}
+	return 0;
+}
+
+/*
+------------------------------------------------------------------------------------
+Read buffer pool (only used from the event loop thread)
+*/
+
+typedef struct dfstream_buf {
+	size_t capacity;
+	struct dfstream_buf *next;
+	char data[1];
+} dfstream_buf;
+
+static dfstream_buf *dfstream_pool;
+static int dfstream_pool_count;
+
+static dfstream_buf *dfstream_buf_acquire(size_t size) {
+	dfstream_buf **cursor, *b;
+
+	for (cursor = &dfstream_pool; *cursor != NULL; cursor = &(*cursor)->next) {
+		if ((*cursor)->capacity >= size) {
+			b = *cursor;
+			*cursor = b->next;
+			dfstream_pool_count--;
+			return b;
+		}
+	}
+
+	b = malloc(sizeof(dfstream_buf) + size);
+	if (b) {
+		b->capacity = size;
+	}
+	return b;
+}
+
+static void dfstream_buf_release(dfstream_buf *b) {
+	if (dfstream_pool_count >= DFSTREAM_POOL_MAX) {
+		free(b);
+		return;
+	}
+	b->next = dfstream_pool;
+	dfstream_pool = b;
+	dfstream_pool_count++;
+}
+
+/*
+------------------------------------------------------------------------------------
+Asynchronous chunk reads
+*/
+
+typedef struct {
+	FILE *f;
+	dfstream_buf *buf;
+	size_t size;
+	size_t n;
+	int err;
+} difstream_req;
+
+/* runs on a worker thread */
+static void difstream_read_work(void *data) {
+	difstream_req *req = data;
+
+	req->n = fread(req->buf->data, 1, req->size, req->f);
+	if (req->n < req->size && ferror(req->f)) {
+		req->err = errno ? errno : EIO;
+		clearerr(req->f);
+	}
+}
+
+/* runs on the event loop thread: callback(err, chunk), an empty chunk marks the end */
+static duk_idx_t difstream_read_done(duk_context *ctx, void *data) {
+	difstream_req *req = data;
+
+	if (req->err) {
+		duk_push_error_object(ctx, DUK_ERR_INTERNAL_ERROR, "could not read from stream: %s", strerror(req->err));
+		duk_push_null(ctx);
+	} else {
+		duk_push_null(ctx);
+		void *bytes = duk_push_buffer_raw(ctx, req->n, DUK_BUF_FLAG_NOZERO);
+		memcpy(bytes, req->buf->data, req->n);
+	}
+
+	dfstream_buf_release(req->buf);
+	free(req);
+	return 2;
+}
+
+/*
+_readChunk(size, callback): reads up to size bytes on the thread pool.
+The caller must keep the stream referenced until the callback runs.
+*/
+static duk_ret_t difstream_read_chunk(duk_context *ctx) {
+	FILE *f = dfstream_file_for_bytes(ctx);
+	duk_int_t size = duk_require_int(ctx, 0);
+	difstream_req *req;
+
+	if (!duk_is_function(ctx, 1)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as second argument");
+		return -1;
+	}
+	if (size <= 0) {
+		size = DFSTREAM_HIGH_WATER_MARK;
+	}
+
+	req = calloc(1, sizeof(difstream_req));
+	if (req == NULL || (req->buf = dfstream_buf_acquire(size)) == NULL) {
+		free(req);
+		duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not allocate read buffer");
+		return -1;
+	}
+	req->f = f;
+	req->size = size;
+
+	dloop_queue_work(ctx, 1, difstream_read_work, difstream_read_done, req);
 	return 0;
 }
 
@@ -77,7 +239,7 @@ static duk_ret_t dfstream_finalizer(duk_context *ctx) {
 */
 
 static duk_ret_t difstream_read(duk_context *ctx) {
-	FILE *f = dfstream_file_from_this(ctx);
+	FILE *f = dfstream_file_for_bytes(ctx);
 
 	if (duk_is_number(ctx, 0)) {
 
@@ -99,36 +261,249 @@ static duk_ret_t difstream_read(duk_context *ctx) {
 	return 1;
 }
 
+/* readInto(buffer, [offset], [length]): fills the buffer, returns the number of bytes read (0 at the end) */
+static duk_ret_t difstream_read_into(duk_context *ctx) {
+	FILE *f = dfstream_file_for_bytes(ctx);
+	duk_size_t sz, offset, length;
+	char *buffer = duk_require_buffer_data(ctx, 0, &sz);
+
+	offset = duk_is_number(ctx, 1) ? (duk_size_t) duk_require_uint(ctx, 1) : 0;
+	if (offset > sz) {
+		duk_error(ctx, DUK_ERR_RANGE_ERROR, "offset out of range");
+		return -1;
+	}
+
+	length = duk_is_number(ctx, 2) ? (duk_size_t) duk_require_uint(ctx, 2) : sz - offset;
+	if (length > sz - offset) {
+		duk_error(ctx, DUK_ERR_RANGE_ERROR, "length out of range");
+		return -1;
+	}
+
+	size_t n = fread(buffer + offset, 1, length, f);
+	if (n < length && ferror(f)) {
+		clearerr(f);
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not read from stream: %s", strerror(errno));
+		return -1;
+	}
+
+	duk_push_uint(ctx, (duk_uint_t) n);
+	return 1;
+}
+
+/* readLines([max]): reads up to max lines (all by default) into an array */
+static duk_ret_t difstream_read_lines(duk_context *ctx) {
+	FILE *f = dfstream_file_from_this(ctx);
+	duk_uarridx_t max = duk_is_number(ctx, 0) ? (duk_uarridx_t) duk_require_uint(ctx, 0) : 0;
+
+	duk_push_this(ctx);
+	duklines_push_array(ctx, f, duklines_require_state(ctx, -1), max);
+	return 1;
+}
+
+/* forEachLine(callback): calls callback(line) until the end of the file or until it returns false */
+static duk_ret_t difstream_for_each_line(duk_context *ctx) {
+	FILE *f = dfstream_file_from_this(ctx);
+	duk_uarridx_t count;
+
+	duk_push_this(ctx);
+	count = duklines_foreach(ctx, f, duklines_require_state(ctx, -1), 0);
+
+	duk_push_uint(ctx, count);
+	return 1;
+}
+
 static duk_ret_t dofstream_write(duk_context *ctx) {
 	FILE *f = dfstream_file_from_this(ctx);
 
-	if (duk_is_buffer(ctx, 0)) {
+	if (duk_is_buffer(ctx, 0) || duk_is_object(ctx, 0)) {
 		
 		void *buffer; duk_size_t sz;
-		buffer = duk_get_buffer(ctx, 0, &sz);
+		buffer = duk_require_buffer_data(ctx, 0, &sz);
 		fwrite(buffer, 1, sz, f);
 
 	} else if (duk_is_string(ctx, 0)) {
 
-		const char *outputs = duk_get_string(ctx, 0);
-		fputs(outputs, f);
+		duk_size_t sz;
+		const char *outputs = duk_get_lstring(ctx, 0, &sz);
+		fwrite(outputs, 1, sz, f);
 
 	}
 
+	/* writes are synchronous, so there is never a need to wait for 'drain' */
+	duk_push_true(ctx);
+	return 1;
+}
+
+#if DUKNODE_PLATFORM_POSIX
+
+#include <sys/uio.h>
+
+#if !defined(IOV_MAX)
+#define IOV_MAX 1024
+#endif
+
+/* write all of iov (which is modified) to fd, returns -1 on errors */
+static int dofstream_writev_all(int fd, struct iovec *iov, int count) {
+	while (count > 0) {
+		ssize_t n = writev(fd, iov, count > IOV_MAX ? IOV_MAX : count);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		/* skip the written chunks and adjust a partially written one */
+		while (count > 0 && (size_t) n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char*) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
 	return 0;
 }
 
+#endif
+
+/* writev(chunks): writes an array of strings and buffers with a single writev call where possible */
+static duk_ret_t dofstream_writev(duk_context *ctx) {
+	FILE *f = dfstream_file_from_this(ctx);
+	duk_size_t count, i;
+
+	if (!duk_is_array(ctx, 0)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "array expected as first argument");
+		return -1;
+	}
+	count = duk_get_length(ctx, 0);
+
+#if DUKNODE_PLATFORM_POSIX
+	{
+		/* the chunks stay reachable through the array while they are written */
+		struct iovec *iov = duk_push_fixed_buffer(ctx, (count > 0 ? count : 1) * sizeof(struct iovec));
+
+		for (i = 0; i < count; i++) {
+			duk_size_t sz;
+			duk_get_prop_index(ctx, 0, (duk_uarridx_t) i);
+			if (duk_is_string(ctx, -1)) {
+				iov[i].iov_base = (void*) duk_get_lstring(ctx, -1, &sz);
+			} else {
+				iov[i].iov_base = duk_require_buffer_data(ctx, -1, &sz);
+			}
+			iov[i].iov_len = sz;
+			duk_pop(ctx);
+		}
+
+		/* earlier write() calls may still sit in the stdio buffer */
+		if (fflush(f) != 0 || dofstream_writev_all(fileno(f), iov, (int) count) != 0) {
+			duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not write to stream: %s", strerror(errno));
+			return -1;
+		}
+	}
+#else
+	/* no writev for files on Windows: stdio gathers the chunks in its buffer instead */
+	for (i = 0; i < count; i++) {
+		const void *data; duk_size_t sz;
+		duk_get_prop_index(ctx, 0, (duk_uarridx_t) i);
+		if (duk_is_string(ctx, -1)) {
+			data = duk_get_lstring(ctx, -1, &sz);
+		} else {
+			data = duk_require_buffer_data(ctx, -1, &sz);
+		}
+		if (fwrite(data, 1, sz, f) != sz) {
+			duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not write to stream: %s", strerror(errno));
+			return -1;
+		}
+		duk_pop(ctx);
+	}
+#endif
+
+	duk_push_true(ctx);
+	return 1;
+}
+
+/* _close(): closes the file (standard streams are only flushed) */
+static duk_ret_t dfstream_close(duk_context *ctx) {
+	FILE *f;
+
+	duk_push_this(ctx);
+	duk_get_prop_string(ctx, -1, DFSTREAM_HANDLE_PROP);
+	f = duk_get_pointer(ctx, -1);
+	duk_pop(ctx);
+
+	if (f == NULL) {
+		return 0;
+	}
+
+	if (f == stdin || f == stdout || f == stderr) {
+		fflush(f);
+		return 0;
+	}
+
+	duk_push_pointer(ctx, NULL);
+	duk_put_prop_string(ctx, -2, DFSTREAM_HANDLE_PROP);
+
+	if (fclose(f) != 0) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not close stream: %s", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+------------------------------------------------------------------------------------
+Events and flow control (called with the readable and writable prototypes)
+*/
+
+static const char _dfstream_src[] = "(function (readable, writable) {"
+	"function on(name, fn) { var ev = this._events || (this._events = {}); (ev[name] || (ev[name] = [])).push(fn); return this; }"
+	"function once(name, fn) { var self = this; function g() { self.removeListener(name, g); fn.apply(self, arguments); } g.listener = fn; return this.on(name, g); }"
+	"function removeListener(name, fn) { var l = this._events && this._events[name]; if (l) { for (var i = 0; i < l.length; i++) { if (l[i] === fn || l[i].listener === fn) { l.splice(i, 1); break; } } } return this; }"
+	"function emit(name) { var l = this._events && this._events[name]; if (!l || !l.length) { if (name === 'error') { throw arguments[1]; } return false; }"
+		"var args = Array.prototype.slice.call(arguments, 1); l = l.slice(); for (var i = 0; i < l.length; i++) { l[i].apply(this, args); } return true; }"
+	"[readable, writable].forEach(function (p) { p.on = p.addListener = on; p.once = once; p.removeListener = removeListener; p.emit = emit; });"
+	"readable.on = readable.addListener = function (name, fn) { on.call(this, name, fn); if (name === 'data' && !this._paused) { this.resume(); } return this; };"
+	"readable.pause = function () { this._paused = true; return this; };"
+	"readable.isPaused = function () { return !!this._paused; };"
+	"readable.resume = function () { this._paused = false;"
+		"if (this._pending) { var chunk = this._pending; this._pending = null; this._deliver(chunk); }"
+		"else if (!this._reading && !this._ended) { this._flow(); } return this; };"
+	"readable._deliver = function (chunk) {"
+		"if (chunk.length === 0) { this._ended = true; this._close(); this.emit('end'); this.emit('close'); return; }"
+		"this.emit('data', chunk); if (!this._paused) { this._flow(); } };"
+	"readable._flow = function () { var self = this; self._reading = true;"
+		"self._readChunk(self.highWaterMark || 0, function (err, chunk) { self._reading = false;"
+			"if (err) { self._ended = true; self.emit('error', err); return; }"
+			"if (self._paused) { self._pending = chunk; } else { self._deliver(chunk); } }); };"
+	"readable.pipe = function (dest, options) { var src = this;"
+		"src.on('data', function (chunk) { if (dest.write(chunk) === false) { src.pause(); dest.once('drain', function () { src.resume(); }); } });"
+		"if (!options || options.end !== false) { src.once('end', function () { if (dest.end) { dest.end(); } }); }"
+		"return dest; };"
+	"writable.end = function (chunk) { if (chunk !== undefined && chunk !== null) { this.write(chunk); } this._close(); this.emit('finish'); this.emit('close'); return this; };"
+"})";
+
 /*
 ------------------------------------------------------------------------------------
 */
 
 static const duk_function_list_entry difstream_prototype[] = {
 	{ "read", difstream_read, 1 },
+	{ "readInto", difstream_read_into, 3 },
+	{ "readLines", difstream_read_lines, 1 },
+	{ "forEachLine", difstream_for_each_line, 1 },
+	{ "_readChunk", difstream_read_chunk, 2 },
+	{ "_close", dfstream_close, 0 },
 	{ NULL, NULL, 0}
 };
 
 static const duk_function_list_entry dofstream_prototype[] = {
 	{ "write", dofstream_write, 1 },
+	{ "writev", dofstream_writev, 1 },
+	{ "_close", dfstream_close, 0 },
 	{ NULL, NULL, 0}
 };
 
@@ -145,4 +520,10 @@ void register_dfstream(duk_context *ctx) {
 	duk_set_finalizer(ctx, -2);
 	duk_put_function_list(ctx, -1, dofstream_prototype);
 	duk_put_global_string(ctx, DOFSTREAM_PROTOTYPE);
+
+	duk_eval_string(ctx, _dfstream_src);
+	duk_get_global_string(ctx, DIFSTREAM_PROTOTYPE);
+	duk_get_global_string(ctx, DOFSTREAM_PROTOTYPE);
+	duk_call(ctx, 2);
+	duk_pop(ctx);
 }
\ No newline at end of file
@@ -0,0 +1,650 @@
+/*
+Event loop for Duktape.
+Implements the timers of Node.js and a libuv-style thread pool
+see: https://nodejs.org/api/timers.html
+
+Implementation notes:
+
+* timers are kept in a binary heap ordered by due time
+* blocking work (e.g. the fs syscalls) runs on a fixed-size pool of worker
+  threads, the callbacks are always called on the thread owning the heap
+* on Linux the loop sleeps in epoll_wait on an eventfd that the workers
+  signal, other platforms wait on a condition variable
+* the pool size can be set with the DUKNODE_THREADPOOL_SIZE environment variable
+
+*/
+
+#include "duknode.h"
+
+#if DUKNODE_PLATFORM_WINDOWS
+
+	typedef HANDLE dloop_thread;
+	typedef CRITICAL_SECTION dloop_mutex;
+	typedef CONDITION_VARIABLE dloop_cond;
+
+	#define dloop_mutex_init(m) InitializeCriticalSection(m)
+	#define dloop_mutex_destroy(m) DeleteCriticalSection(m)
+	#define dloop_mutex_lock(m) EnterCriticalSection(m)
+	#define dloop_mutex_unlock(m) LeaveCriticalSection(m)
+	#define dloop_cond_init(c) InitializeConditionVariable(c)
+	#define dloop_cond_destroy(c) (void)(c)
+	#define dloop_cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+	#define dloop_cond_signal(c) WakeConditionVariable(c)
+	#define dloop_cond_broadcast(c) WakeAllConditionVariable(c)
+
+#else
+
+	#include <pthread.h>
+	#include <time.h>
+
+	typedef pthread_t dloop_thread;
+	typedef pthread_mutex_t dloop_mutex;
+	typedef pthread_cond_t dloop_cond;
+
+	#define dloop_mutex_init(m) pthread_mutex_init(m, NULL)
+	#define dloop_mutex_destroy(m) pthread_mutex_destroy(m)
+	#define dloop_mutex_lock(m) pthread_mutex_lock(m)
+	#define dloop_mutex_unlock(m) pthread_mutex_unlock(m)
+	#define dloop_cond_init(c) pthread_cond_init(c, NULL)
+	#define dloop_cond_destroy(c) pthread_cond_destroy(c)
+	#define dloop_cond_wait(c, m) pthread_cond_wait(c, m)
+	#define dloop_cond_signal(c) pthread_cond_signal(c)
+	#define dloop_cond_broadcast(c) pthread_cond_broadcast(c)
+
+	#if DUKNODE_PLATFORM_LINUX
+		#define DLOOP_USE_EPOLL 1
+		#include <sys/epoll.h>
+		#include <sys/eventfd.h>
+	#endif
+
+#endif
+
+/*
+------------------------------------------------------------------------------------
+*/
+
+/* default number of worker threads */
+#define DLOOP_THREADPOOL_SIZE 4
+/* maximum number of worker threads */
+#define DLOOP_THREADPOOL_MAX 128
+/* environment variable to override the number of worker threads */
+#define DLOOP_THREADPOOL_ENV "DUKNODE_THREADPOOL_SIZE"
+
+/* heap stash properties holding the callbacks */
+#define DLOOP_CALLBACKS_PROP "dloop_callbacks"
+#define DLOOP_TIMERS_PROP "dloop_timers"
+
+/* minimum delay of a timer in milliseconds (same as Node.js) */
+#define DLOOP_MIN_DELAY 1.0
+
+typedef struct dloop_work {
+	duk_uint_t id;
+	void *data;
+	dloop_work_cb work;
+	dloop_done_cb done;
+	struct dloop_work *next;
+} dloop_work;
+
+typedef struct {
+	double due;
+	double interval; /* zero for one-shot timers */
+	duk_uint_t id;
+	duk_uint_t seq; /* keeps timers with the same due time in insertion order */
+} dloop_timer;
+
+static struct {
+	int started;
+	int stopping;
+
+	/* thread pool */
+	int nthreads;
+	dloop_thread threads[DLOOP_THREADPOOL_MAX];
+	dloop_mutex lock;
+	dloop_cond work_cond;    /* signalled when work is queued */
+	dloop_work *todo_head, *todo_tail;
+	dloop_work *done_head, *done_tail;
+
+#if DLOOP_USE_EPOLL
+	int epfd;
+	int evfd;
+#else
+	dloop_cond done_cond;    /* signalled when work is finished */
+#endif
+
+	/* number of queued work items whose callback has not run yet */
+	duk_uint_t pending;
+	duk_uint_t next_work_id;
+
+	/* timer heap */
+	dloop_timer *timers;
+	duk_uint_t ntimers, timers_cap;
+	duk_uint_t active_timers;
+	duk_uint_t next_timer_id;
+	duk_uint_t next_timer_seq;
+} dloop;
+
+/*
+------------------------------------------------------------------------------------
+*/
+
+double dloop_now(void) {
+#if DUKNODE_PLATFORM_WINDOWS
+	return (double) GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((double) ts.tv_sec) * 1000.0 + ((double) ts.tv_nsec) / 1000000.0;
+#endif
+}
+
+static void dloop_push_stash_table(duk_context *ctx, const char *name) {
+	duk_push_heap_stash(ctx);
+	if (!duk_get_prop_string(ctx, -1, name)) {
+		duk_pop(ctx);
+		duk_push_object(ctx);
+		duk_dup_top(ctx);
+		duk_put_prop_string(ctx, -3, name);
+	}
+	duk_remove(ctx, -2);
+}
+
+/*
+------------------------------------------------------------------------------------
+Thread pool
+*/
+
+static void dloop_signal_done(void) {
+#if DLOOP_USE_EPOLL
+	uint64_t one = 1;
+	ssize_t n = write(dloop.evfd, &one, sizeof(one));
+	(void) n; /* a full counter still wakes up the loop */
+#else
+	dloop_cond_signal(&dloop.done_cond);
+#endif
+}
+
+static void dloop_worker(void) {
+	dloop_work *w;
+
+	for (;;) {
+		dloop_mutex_lock(&dloop.lock);
+		while (dloop.todo_head == NULL && !dloop.stopping) {
+			dloop_cond_wait(&dloop.work_cond, &dloop.lock);
+		}
+		if (dloop.todo_head == NULL) {
+			dloop_mutex_unlock(&dloop.lock);
+			return;
+		}
+		w = dloop.todo_head;
+		dloop.todo_head = w->next;
+		if (dloop.todo_head == NULL) {
+			dloop.todo_tail = NULL;
+		}
+		dloop_mutex_unlock(&dloop.lock);
+
+		w->work(w->data);
+
+		dloop_mutex_lock(&dloop.lock);
+		w->next = NULL;
+		if (dloop.done_tail) {
+			dloop.done_tail->next = w;
+		} else {
+			dloop.done_head = w;
+		}
+		dloop.done_tail = w;
+		dloop_signal_done();
+		dloop_mutex_unlock(&dloop.lock);
+	}
+}
+
+#if DUKNODE_PLATFORM_WINDOWS
+static DWORD WINAPI dloop_thread_main(LPVOID arg) {
+	(void) arg;
+	dloop_worker();
+	return 0;
+}
+#else
+static void *dloop_thread_main(void *arg) {
+	(void) arg;
+	dloop_worker();
+	return NULL;
+}
+#endif
+
+static void dloop_start(duk_context *ctx) {
+	int i, nthreads = DLOOP_THREADPOOL_SIZE;
+	const char *env = getenv(DLOOP_THREADPOOL_ENV);
+
+	if (env && atoi(env) > 0) {
+		nthreads = atoi(env);
+	}
+	if (nthreads > DLOOP_THREADPOOL_MAX) {
+		nthreads = DLOOP_THREADPOOL_MAX;
+	}
+
+	dloop_mutex_init(&dloop.lock);
+	dloop_cond_init(&dloop.work_cond);
+
+#if DLOOP_USE_EPOLL
+	struct epoll_event ev;
+
+	dloop.evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	dloop.epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (dloop.evfd < 0 || dloop.epfd < 0) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not create event loop: %s", strerror(errno));
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = dloop.evfd;
+	if (epoll_ctl(dloop.epfd, EPOLL_CTL_ADD, dloop.evfd, &ev) != 0) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not create event loop: %s", strerror(errno));
+	}
+#else
+	dloop_cond_init(&dloop.done_cond);
+#endif
+
+	for (i = 0; i < nthreads; i++) {
+#if DUKNODE_PLATFORM_WINDOWS
+		dloop.threads[i] = CreateThread(NULL, 0, dloop_thread_main, NULL, 0, NULL);
+		if (dloop.threads[i] == NULL) {
+			break;
+		}
+#else
+		if (pthread_create(&dloop.threads[i], NULL, dloop_thread_main, NULL) != 0) {
+			break;
+		}
+#endif
+	}
+
+	dloop.nthreads = i;
+	dloop.started = 1;
+
+	if (dloop.nthreads == 0) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not start worker threads");
+	}
+}
+
+void dloop_queue_work(duk_context *ctx, duk_idx_t cb_index, dloop_work_cb work, dloop_done_cb done, void *data) {
+	dloop_work *w;
+
+	cb_index = duk_require_normalize_index(ctx, cb_index);
+
+	if (!dloop.started) {
+		dloop_start(ctx);
+	}
+
+	w = malloc(sizeof(dloop_work));
+	if (w == NULL) {
+		duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not allocate work request");
+	}
+
+	w->id = ++dloop.next_work_id;
+	w->data = data;
+	w->work = work;
+	w->done = done;
+	w->next = NULL;
+
+	/* keep the callback alive until the work is done */
+	dloop_push_stash_table(ctx, DLOOP_CALLBACKS_PROP);
+	duk_dup(ctx, cb_index);
+	duk_put_prop_index(ctx, -2, w->id);
+	duk_pop(ctx);
+
+	dloop.pending++;
+
+	dloop_mutex_lock(&dloop.lock);
+	if (dloop.todo_tail) {
+		dloop.todo_tail->next = w;
+	} else {
+		dloop.todo_head = w;
+	}
+	dloop.todo_tail = w;
+	dloop_cond_signal(&dloop.work_cond);
+	dloop_mutex_unlock(&dloop.lock);
+}
+
+static dloop_work *dloop_take_done(void) {
+	dloop_work *w;
+
+	dloop_mutex_lock(&dloop.lock);
+	w = dloop.done_head;
+	if (w) {
+		dloop.done_head = w->next;
+		if (dloop.done_head == NULL) {
+			dloop.done_tail = NULL;
+		}
+	}
+	dloop_mutex_unlock(&dloop.lock);
+
+	return w;
+}
+
+static void dloop_run_done(duk_context *ctx) {
+	dloop_work *w;
+	duk_idx_t nargs;
+
+	if (!dloop.started) {
+		return;
+	}
+
+	while ((w = dloop_take_done()) != NULL) {
+		dloop_push_stash_table(ctx, DLOOP_CALLBACKS_PROP);
+		duk_get_prop_index(ctx, -1, w->id);
+		duk_del_prop_index(ctx, -2, w->id);
+		duk_remove(ctx, -2);
+
+		dloop.pending--;
+
+		/* done pushes the callback arguments and releases the data */
+		nargs = w->done(ctx, w->data);
+		free(w);
+
+		duk_call(ctx, nargs);
+		duk_pop(ctx);
+	}
+}
+
+/* wait until work finishes or timeout (milliseconds, negative for no limit) expires */
+static void dloop_wait(double timeout) {
+#if DLOOP_USE_EPOLL
+	struct epoll_event events[16];
+	uint64_t count;
+	int i, n;
+
+	n = epoll_wait(dloop.epfd, events, 16, timeout < 0 ? -1 : (int) timeout);
+	for (i = 0; i < n; i++) {
+		if (events[i].data.fd == dloop.evfd) {
+			while (read(dloop.evfd, &count, sizeof(count)) > 0) {}
+		}
+	}
+#else
+	dloop_mutex_lock(&dloop.lock);
+	if (dloop.done_head == NULL) {
+#if DUKNODE_PLATFORM_WINDOWS
+		SleepConditionVariableCS(&dloop.done_cond, &dloop.lock, timeout < 0 ? INFINITE : (DWORD) timeout);
+#else
+		if (timeout < 0) {
+			pthread_cond_wait(&dloop.done_cond, &dloop.lock);
+		} else {
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += (time_t) (timeout / 1000);
+			ts.tv_nsec += (long) ((timeout - ((time_t) (timeout / 1000)) * 1000) * 1000000);
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&dloop.done_cond, &dloop.lock, &ts);
+		}
+#endif
+	}
+	dloop_mutex_unlock(&dloop.lock);
+#endif
+}
+
+static void dloop_sleep(double timeout) {
+#if DUKNODE_PLATFORM_WINDOWS
+	Sleep((DWORD) timeout);
+#else
+	struct timespec ts;
+	ts.tv_sec = (time_t) (timeout / 1000);
+	ts.tv_nsec = (long) ((timeout - ts.tv_sec * 1000) * 1000000);
+	nanosleep(&ts, NULL);
+#endif
+}
+
+void dloop_close(void) {
+	int i;
+	dloop_work *w;
+
+	if (!dloop.started) {
+		return;
+	}
+
+	dloop_mutex_lock(&dloop.lock);
+	dloop.stopping = 1;
+	dloop_cond_broadcast(&dloop.work_cond);
+	dloop_mutex_unlock(&dloop.lock);
+
+	for (i = 0; i < dloop.nthreads; i++) {
+#if DUKNODE_PLATFORM_WINDOWS
+		WaitForSingleObject(dloop.threads[i], INFINITE);
+		CloseHandle(dloop.threads[i]);
+#else
+		pthread_join(dloop.threads[i], NULL);
+#endif
+	}
+
+	/* the heap is gone, so results that were never delivered are dropped */
+	while ((w = dloop.done_head) != NULL) {
+		dloop.done_head = w->next;
+		free(w);
+	}
+
+#if DLOOP_USE_EPOLL
+	close(dloop.epfd);
+	close(dloop.evfd);
+#else
+	dloop_cond_destroy(&dloop.done_cond);
+#endif
+	dloop_cond_destroy(&dloop.work_cond);
+	dloop_mutex_destroy(&dloop.lock);
+
+	free(dloop.timers);
+	memset(&dloop, 0, sizeof(dloop));
+}
+
+/*
+------------------------------------------------------------------------------------
+Timer heap
+*/
+
+static int dloop_timer_before(dloop_timer *a, dloop_timer *b) {
+	if (a->due != b->due) {
+		return a->due < b->due;
+	}
+	return a->seq < b->seq;
+}
+
+static void dloop_timer_insert(duk_context *ctx, dloop_timer *t) {
+	duk_uint_t i, parent;
+	dloop_timer tmp;
+
+	if (dloop.ntimers == dloop.timers_cap) {
+		duk_uint_t cap = dloop.timers_cap ? dloop.timers_cap * 2 : 16;
+		dloop_timer *timers = realloc(dloop.timers, cap * sizeof(dloop_timer));
+		if (timers == NULL) {
+			duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not allocate timer");
+		}
+		dloop.timers = timers;
+		dloop.timers_cap = cap;
+	}
+
+	t->seq = dloop.next_timer_seq++;
+	i = dloop.ntimers++;
+	dloop.timers[i] = *t;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!dloop_timer_before(&dloop.timers[i], &dloop.timers[parent])) {
+			break;
+		}
+		tmp = dloop.timers[i];
+		dloop.timers[i] = dloop.timers[parent];
+		dloop.timers[parent] = tmp;
+		i = parent;
+	}
+}
+
+static void dloop_timer_pop(dloop_timer *out) {
+	duk_uint_t i = 0, child;
+	dloop_timer tmp;
+
+	*out = dloop.timers[0];
+	dloop.timers[0] = dloop.timers[--dloop.ntimers];
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= dloop.ntimers) {
+			break;
+		}
+		if (child + 1 < dloop.ntimers && dloop_timer_before(&dloop.timers[child + 1], &dloop.timers[child])) {
+			child++;
+		}
+		if (!dloop_timer_before(&dloop.timers[child], &dloop.timers[i])) {
+			break;
+		}
+		tmp = dloop.timers[i];
+		dloop.timers[i] = dloop.timers[child];
+		dloop.timers[child] = tmp;
+		i = child;
+	}
+}
+
+static void dloop_run_timers(duk_context *ctx) {
+	dloop_timer t;
+	duk_idx_t i, nargs;
+	double now = dloop_now();
+
+	dloop_push_stash_table(ctx, DLOOP_TIMERS_PROP);
+
+	while (dloop.ntimers > 0 && dloop.timers[0].due <= now) {
+		dloop_timer_pop(&t);
+
+		/* cleared timers are removed from the stash but left in the heap */
+		if (!duk_get_prop_index(ctx, -1, t.id)) {
+			duk_pop(ctx);
+			continue;
+		}
+
+		/* [ ... timers entry ] where entry is [ callback, args... ] */
+		nargs = (duk_idx_t) duk_get_length(ctx, -1) - 1;
+		for (i = 0; i <= nargs; i++) {
+			duk_get_prop_index(ctx, -1 - i, i);
+		}
+
+		if (t.interval > 0) {
+			t.due = now + t.interval;
+			dloop_timer_insert(ctx, &t);
+		} else {
+			duk_del_prop_index(ctx, -3 - nargs, t.id);
+			dloop.active_timers--;
+		}
+
+		duk_call(ctx, nargs);
+		duk_pop_2(ctx);
+	}
+
+	duk_pop(ctx);
+}
+
+static duk_ret_t dloop_add_timer(duk_context *ctx, int repeat) {
+	dloop_timer t;
+	duk_idx_t i, nargs = duk_get_top(ctx);
+	double delay;
+
+	if (!duk_is_function(ctx, 0)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as first argument");
+		return -1;
+	}
+
+	delay = (nargs > 1) ? duk_to_number(ctx, 1) : 0.0;
+	if (!(delay >= DLOOP_MIN_DELAY)) { /* also catches NaN */
+		delay = DLOOP_MIN_DELAY;
+	}
+
+	t.id = ++dloop.next_timer_id;
+	t.due = dloop_now() + delay;
+	t.interval = repeat ? delay : 0;
+
+	/* stash entry is [ callback, args... ] */
+	dloop_push_stash_table(ctx, DLOOP_TIMERS_PROP);
+	duk_push_array(ctx);
+	duk_dup(ctx, 0);
+	duk_put_prop_index(ctx, -2, 0);
+	for (i = 2; i < nargs; i++) {
+		duk_dup(ctx, i);
+		duk_put_prop_index(ctx, -2, i - 1);
+	}
+	duk_put_prop_index(ctx, -2, t.id);
+	duk_pop(ctx);
+
+	dloop_timer_insert(ctx, &t);
+	dloop.active_timers++;
+
+	duk_push_uint(ctx, t.id);
+	return 1;
+}
+
+static duk_ret_t dloop_settimeout(duk_context *ctx) {
+	return dloop_add_timer(ctx, 0);
+}
+
+static duk_ret_t dloop_setinterval(duk_context *ctx) {
+	return dloop_add_timer(ctx, 1);
+}
+
+static duk_ret_t dloop_cleartimer(duk_context *ctx) {
+	duk_uint_t id;
+
+	if (!duk_is_number(ctx, 0)) {
+		return 0;
+	}
+	id = duk_get_uint(ctx, 0);
+
+	dloop_push_stash_table(ctx, DLOOP_TIMERS_PROP);
+	if (duk_has_prop_index(ctx, -1, id)) {
+		duk_del_prop_index(ctx, -1, id);
+		dloop.active_timers--;
+	}
+	duk_pop(ctx);
+
+	return 0;
+}
+
+/*
+------------------------------------------------------------------------------------
+*/
+
+/* runs until there are no more active timers and no more pending work */
+void dloop_run(duk_context *ctx) {
+	double timeout;
+
+	for (;;) {
+		dloop_run_timers(ctx);
+		dloop_run_done(ctx);
+
+		if (dloop.active_timers == 0 && dloop.pending == 0) {
+			break;
+		}
+
+		timeout = -1;
+		if (dloop.ntimers > 0) {
+			timeout = dloop.timers[0].due - dloop_now();
+			if (timeout < 0) {
+				timeout = 0;
+			}
+		}
+
+		if (dloop.pending > 0) {
+			dloop_wait(timeout);
+		} else {
+			dloop_sleep(timeout);
+		}
+	}
+}
+
+static const duk_function_list_entry dloop_timer_functions[] = {
+	{ "setTimeout", dloop_settimeout, DUK_VARARGS },
+	{ "setInterval", dloop_setinterval, DUK_VARARGS },
+	{ "clearTimeout", dloop_cleartimer, 1 },
+	{ "clearInterval", dloop_cleartimer, 1 },
+	{ NULL, NULL, 0}
+};
+
+void register_dloop(duk_context *ctx) {
+	duk_push_global_object(ctx);
+	duk_put_function_list(ctx, -1, dloop_timer_functions);
+	duk_pop(ctx);
+}
@@ -6,10 +6,21 @@ see: https://nodejs.org/api/process.html
 Notes:
 
 * depends on dfstream.c
+* memoryUsage() reports the allocator statistics of heaps created with
+  dukalloc_create_heap (see dukalloc/dukalloc.h), only rss otherwise
+* Duktape has no hook for garbage collection, so gcStats() counts automatic
+  mark-and-sweep runs with a canary: an object kept alive only by a reference
+  cycle, whose finalizer runs when a mark-and-sweep pass collects it.
+  Durations are only measured for collections started with process.gc()
 
 */
 
 #include "duknode.h"
+#include "../dukalloc/dukalloc.h"
+
+#if DUKNODE_PLATFORM_WINDOWS
+#include <psapi.h>
+#endif
 
 
 /*
@@ -99,6 +110,149 @@ static duk_ret_t dprocess_setenv(duk_context *ctx) {
 	return 0;
 }
 
+/*
+------------------------------------------------------------------------------------
+Memory and garbage collection
+*/
+
+static struct {
+	unsigned long runs;   /* mark-and-sweep runs seen by the canary */
+	double last_run;
+	unsigned long forced; /* runs started with process.gc() */
+	double forced_time;
+	double last_forced_time;
+} dprocess_gc;
+
+static size_t dprocess_rss(void) {
+#if DUKNODE_PLATFORM_WINDOWS
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+		return (size_t) pmc.WorkingSetSize;
+	}
+	return 0;
+#else
+	unsigned long size, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+
+	if (f == NULL) {
+		return 0;
+	}
+	if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+		resident = 0;
+	}
+	fclose(f);
+
+	return (size_t) resident * (size_t) sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static void dprocess_push_gc_canary(duk_context *ctx);
+
+static duk_ret_t dprocess_gc_canary_finalizer(duk_context *ctx) {
+	/* the second argument is true when the heap is being destroyed */
+	if (duk_get_boolean(ctx, 1)) {
+		return 0;
+	}
+
+	dprocess_gc.runs++;
+	dprocess_gc.last_run = dloop_now();
+
+	dprocess_push_gc_canary(ctx);
+	return 0;
+}
+
+static void dprocess_push_gc_canary(duk_context *ctx) {
+	duk_push_object(ctx);
+
+	/* the cycle keeps the refcount above zero, only mark-and-sweep frees it */
+	duk_dup_top(ctx);
+	duk_put_prop_string(ctx, -2, "self");
+
+	duk_push_c_function(ctx, dprocess_gc_canary_finalizer, 2);
+	duk_set_finalizer(ctx, -2);
+
+	duk_pop(ctx);
+}
+
+static void dprocess_push_size(duk_context *ctx, const char *name, size_t value) {
+	duk_push_number(ctx, (duk_double_t) value);
+	duk_put_prop_string(ctx, -2, name);
+}
+
+/* memoryUsage(): rss, heapTotal, heapUsed and the allocator statistics */
+static duk_ret_t dprocess_memory_usage(duk_context *ctx) {
+	const dukalloc_stats *st = dukalloc_get_stats(ctx);
+	int i;
+
+	duk_push_object(ctx);
+	dprocess_push_size(ctx, "rss", dprocess_rss());
+
+	if (st == NULL) {
+		return 1;
+	}
+
+	dprocess_push_size(ctx, "heapTotal", st->reserved_bytes + st->malloc_bytes);
+	dprocess_push_size(ctx, "heapUsed", st->live_bytes);
+	dprocess_push_size(ctx, "heapPeak", st->peak_bytes);
+	dprocess_push_size(ctx, "allocs", st->allocs);
+	dprocess_push_size(ctx, "reallocs", st->reallocs);
+	dprocess_push_size(ctx, "frees", st->frees);
+
+	duk_push_string(ctx, st->mode == DUKALLOC_POOL ? "pool" : "system");
+	duk_put_prop_string(ctx, -2, "allocator");
+
+	/* size 0 is the entry of allocations larger than all classes */
+	duk_push_array(ctx);
+	for (i = 0; i <= DUKALLOC_NUM_CLASSES; i++) {
+		const dukalloc_class_stats *cs = &st->classes[i];
+
+		duk_push_object(ctx);
+		dprocess_push_size(ctx, "size", cs->size);
+		dprocess_push_size(ctx, "allocs", cs->allocs);
+		dprocess_push_size(ctx, "frees", cs->frees);
+		dprocess_push_size(ctx, "live", cs->live);
+		dprocess_push_size(ctx, "peak", cs->peak);
+		duk_put_prop_index(ctx, -2, i);
+	}
+	duk_put_prop_string(ctx, -2, "sizeClasses");
+
+	return 1;
+}
+
+/* gc(): runs a full mark-and-sweep */
+static duk_ret_t dprocess_gc_run(duk_context *ctx) {
+	double start = dloop_now();
+
+	duk_gc(ctx, 0);
+
+	dprocess_gc.forced++;
+	dprocess_gc.last_forced_time = dloop_now() - start;
+	dprocess_gc.forced_time += dprocess_gc.last_forced_time;
+	return 0;
+}
+
+/* gcStats(): mark-and-sweep runs (including forced ones), time of the last one on the event loop clock and time spent in forced runs, in ms */
+static duk_ret_t dprocess_gc_stats(duk_context *ctx) {
+	duk_push_object(ctx);
+
+	duk_push_number(ctx, (duk_double_t) dprocess_gc.runs);
+	duk_put_prop_string(ctx, -2, "runs");
+
+	duk_push_number(ctx, dprocess_gc.last_run);
+	duk_put_prop_string(ctx, -2, "lastRun");
+
+	duk_push_number(ctx, (duk_double_t) dprocess_gc.forced);
+	duk_put_prop_string(ctx, -2, "forcedRuns");
+
+	duk_push_number(ctx, dprocess_gc.forced_time);
+	duk_put_prop_string(ctx, -2, "forcedTime");
+
+	duk_push_number(ctx, dprocess_gc.last_forced_time);
+	duk_put_prop_string(ctx, -2, "lastForcedTime");
+
+	return 1;
+}
+
 /*
 ------------------------------------------------------------------------------------
 */
@@ -109,6 +263,9 @@ static const duk_function_list_entry process_methods[] = {
 	{ "exit", dprocess_exit, 1 },
 	{ "getenv", dprocess_getenv, 1 },
 	{ "setenv", dprocess_setenv, 2 },
+	{ "memoryUsage", dprocess_memory_usage, 0 },
+	{ "gc", dprocess_gc_run, 0 },
+	{ "gcStats", dprocess_gc_stats, 0 },
 	{ NULL, NULL, 0}
 };
 
@@ -136,4 +293,6 @@ void register_dprocess(duk_context *ctx) {
 	duk_put_prop_string(ctx, -2, "stdin");
 
 	duk_put_global_string(ctx, "process");
+
+	dprocess_push_gc_canary(ctx);
 }
\ No newline at end of file
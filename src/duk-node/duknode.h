@@ -82,6 +82,7 @@ Based on the Foundation Library (see: https://github.com/rampantpixels/foundatio
 
 	#include <unistd.h>
 	#include <limits.h>
+	#include <dirent.h>
 
 #endif
 
@@ -96,6 +97,22 @@ void push_dofstream(duk_context *ctx, FILE *outputf);
 FILE* dfstream_require_file(duk_context *ctx, int index);
 void register_dfstream(duk_context *ctx);
 
+/*
+Event loop (see dloop.c)
+
+work runs on a worker thread and must not touch the Duktape heap,
+done runs on the loop thread, pushes the callback arguments, releases
+the data and returns the number of arguments pushed.
+*/
+typedef void (*dloop_work_cb)(void *data);
+typedef duk_idx_t (*dloop_done_cb)(duk_context *ctx, void *data);
+
+void dloop_queue_work(duk_context *ctx, duk_idx_t cb_index, dloop_work_cb work, dloop_done_cb done, void *data);
+void dloop_run(duk_context *ctx);
+double dloop_now(void);
+void dloop_close(void);
+void register_dloop(duk_context *ctx);
+
 /* register modSearch */
 void register_mod_search(duk_context *ctx);
 
@@ -1,4 +1,5 @@
 #include "duknode.h"
+#include "../dukalloc/dukalloc.h"
 
 /*
 ------------------------------------------------------------------------------------
@@ -25,15 +26,19 @@ static duk_ret_t pmain (duk_context *ctx) {
     }
     duk_pop(ctx);  /* ignore result */
 
+    dloop_run(ctx);
+
     return 0;
 }
 
 
 int main(int argc, const char *argv[]) {
     duk_context *ctx = NULL;
+    dukalloc_options alloc_opts;
     int code = 0;
 
-    ctx = duk_create_heap_default();
+    dukalloc_parse_options(&alloc_opts, &argc, argv);
+    ctx = dukalloc_create_heap(&alloc_opts, NULL);
     if (!ctx) {
         printf("Failed to create a Duktape heap.\n");
         exit(1);
@@ -47,7 +52,8 @@ int main(int argc, const char *argv[]) {
 		code = 1;
 	}
 
-    duk_destroy_heap(ctx);
+    dloop_close();
+    dukalloc_destroy_heap(ctx);
     
     return code;
 }
@@ -62,6 +68,7 @@ static void prepare_duk_env(duk_context *ctx) {
 
 	register_dconsole(ctx);
 	register_dprocess(ctx);
+	register_dloop(ctx);
 
 	preload_dos(ctx);
 	preload_dfs(ctx);
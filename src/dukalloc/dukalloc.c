@@ -0,0 +1,462 @@
+/*
+Allocators for the Duktape host programs (see dukalloc.h).
+
+Implementation notes:
+
+* pooled blocks come from 64K chunks aligned to their size, so the chunk of a
+  pointer is found by masking its address and looking it up in a small hash
+  set of chunk addresses; anything else came from malloc and carries a header
+  with its size
+* each class keeps a free list and carves new blocks from its current chunk
+  on demand; chunks are only returned to the system when the heap is destroyed
+* based on the idea of examples/alloc-hybrid from the Duktape distribution
+  (a Duktape heap is only used from one thread, so there is no locking)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#include "dukalloc.h"
+
+
+/*
+------------------------------------------------------------------------------------
+*/
+
+#define DUKALLOC_CHUNK_SIZE (64 * 1024)
+#define DUKALLOC_CHUNK_HEADER 16
+#define DUKALLOC_MAX_POOLED 1024
+#define DUKALLOC_LARGE DUKALLOC_NUM_CLASSES /* stats entry of malloc'd blocks */
+
+static const size_t dukalloc_class_sizes[DUKALLOC_NUM_CLASSES] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024
+};
+
+/* header of malloc'd blocks, keeps the returned pointer aligned for doubles */
+typedef union {
+	size_t size;
+	double d;
+	void *p;
+} dukalloc_header;
+
+typedef struct dukalloc_free_block {
+	struct dukalloc_free_block *next;
+} dukalloc_free_block;
+
+typedef struct {
+	dukalloc_free_block *free;
+	char *bump;     /* next uncarved block of the current chunk */
+	char *bump_end;
+} dukalloc_pool;
+
+typedef struct {
+	dukalloc_stats stats;
+	int print_stats;
+	dukalloc_pool pools[DUKALLOC_NUM_CLASSES];
+	/* (size + 15) / 16 -> class index */
+	unsigned char class_of[DUKALLOC_MAX_POOLED / 16 + 1];
+	/* open addressing set of chunk addresses */
+	uintptr_t *chunks;
+	size_t chunks_cap;
+} dukalloc_state;
+
+/*
+------------------------------------------------------------------------------------
+Statistics
+*/
+
+static void dukalloc_count_alloc(dukalloc_state *st, int cls, size_t bytes) {
+	dukalloc_class_stats *cs = &st->stats.classes[cls];
+
+	cs->allocs++;
+	if (++cs->live > cs->peak) {
+		cs->peak = cs->live;
+	}
+
+	st->stats.live_bytes += bytes;
+	if (st->stats.live_bytes > st->stats.peak_bytes) {
+		st->stats.peak_bytes = st->stats.live_bytes;
+	}
+}
+
+static void dukalloc_count_free(dukalloc_state *st, int cls, size_t bytes) {
+	dukalloc_class_stats *cs = &st->stats.classes[cls];
+
+	cs->frees++;
+	cs->live--;
+	st->stats.live_bytes -= bytes;
+}
+
+/* a block resized by realloc (a free and an alloc in the class statistics if its class changes) */
+static void dukalloc_count_resize(dukalloc_state *st, int old_cls, size_t old_bytes, int cls, size_t bytes) {
+	if (old_cls != cls) {
+		dukalloc_count_free(st, old_cls, old_bytes);
+		dukalloc_count_alloc(st, cls, bytes);
+		return;
+	}
+
+	st->stats.live_bytes = st->stats.live_bytes - old_bytes + bytes;
+	if (st->stats.live_bytes > st->stats.peak_bytes) {
+		st->stats.peak_bytes = st->stats.live_bytes;
+	}
+}
+
+/* class used for the statistics of a size (DUKALLOC_LARGE if it is not pooled) */
+static int dukalloc_class(dukalloc_state *st, size_t size) {
+	return size <= DUKALLOC_MAX_POOLED ? st->class_of[(size + 15) >> 4] : DUKALLOC_LARGE;
+}
+
+/*
+------------------------------------------------------------------------------------
+Chunk set
+*/
+
+static size_t dukalloc_chunk_slot(uintptr_t chunk, size_t cap) {
+	return (size_t) (((chunk / DUKALLOC_CHUNK_SIZE) * 2654435761u) & (cap - 1));
+}
+
+static int dukalloc_chunk_insert(dukalloc_state *st, uintptr_t chunk) {
+	size_t i;
+
+	if ((st->stats.chunks + 1) * 2 > st->chunks_cap) {
+		size_t cap = st->chunks_cap ? st->chunks_cap * 2 : 64;
+		uintptr_t *chunks = calloc(cap, sizeof(uintptr_t));
+		if (chunks == NULL) {
+			return -1;
+		}
+
+		for (i = 0; i < st->chunks_cap; i++) {
+			if (st->chunks[i]) {
+				size_t j = dukalloc_chunk_slot(st->chunks[i], cap);
+				while (chunks[j]) {
+					j = (j + 1) & (cap - 1);
+				}
+				chunks[j] = st->chunks[i];
+			}
+		}
+
+		free(st->chunks);
+		st->chunks = chunks;
+		st->chunks_cap = cap;
+	}
+
+	i = dukalloc_chunk_slot(chunk, st->chunks_cap);
+	while (st->chunks[i]) {
+		i = (i + 1) & (st->chunks_cap - 1);
+	}
+	st->chunks[i] = chunk;
+	return 0;
+}
+
+/* chunk holding ptr, 0 if ptr was not pooled */
+static uintptr_t dukalloc_chunk_find(dukalloc_state *st, void *ptr) {
+	uintptr_t chunk = (uintptr_t) ptr & ~(uintptr_t) (DUKALLOC_CHUNK_SIZE - 1);
+	size_t i;
+
+	if (st->chunks_cap == 0) {
+		return 0;
+	}
+
+	i = dukalloc_chunk_slot(chunk, st->chunks_cap);
+	while (st->chunks[i]) {
+		if (st->chunks[i] == chunk) {
+			return chunk;
+		}
+		i = (i + 1) & (st->chunks_cap - 1);
+	}
+	return 0;
+}
+
+static void *dukalloc_chunk_new(void) {
+#if defined(_WIN32)
+	return _aligned_malloc(DUKALLOC_CHUNK_SIZE, DUKALLOC_CHUNK_SIZE);
+#else
+	void *chunk;
+	return posix_memalign(&chunk, DUKALLOC_CHUNK_SIZE, DUKALLOC_CHUNK_SIZE) == 0 ? chunk : NULL;
+#endif
+}
+
+static void dukalloc_chunk_free(void *chunk) {
+#if defined(_WIN32)
+	_aligned_free(chunk);
+#else
+	free(chunk);
+#endif
+}
+
+/*
+------------------------------------------------------------------------------------
+Allocation functions
+*/
+
+static void *dukalloc_large_alloc(dukalloc_state *st, size_t size) {
+	dukalloc_header *h = malloc(sizeof(dukalloc_header) + size);
+	if (h == NULL) {
+		return NULL;
+	}
+	h->size = size;
+
+	st->stats.malloc_bytes += size;
+	dukalloc_count_alloc(st, dukalloc_class(st, size), size);
+	return h + 1;
+}
+
+static void *dukalloc_pool_alloc(dukalloc_state *st, int cls) {
+	dukalloc_pool *pool = &st->pools[cls];
+	size_t size = dukalloc_class_sizes[cls];
+	void *ptr;
+
+	if (pool->free) {
+		ptr = pool->free;
+		pool->free = pool->free->next;
+	} else {
+		if (pool->bump == NULL || pool->bump + size > pool->bump_end) {
+			char *chunk = dukalloc_chunk_new();
+			if (chunk == NULL) {
+				return NULL;
+			}
+			if (dukalloc_chunk_insert(st, (uintptr_t) chunk) != 0) {
+				dukalloc_chunk_free(chunk);
+				return NULL;
+			}
+
+			chunk[0] = (char) cls;
+			pool->bump = chunk + DUKALLOC_CHUNK_HEADER;
+			pool->bump_end = chunk + DUKALLOC_CHUNK_SIZE;
+
+			st->stats.chunks++;
+			st->stats.reserved_bytes += DUKALLOC_CHUNK_SIZE;
+		}
+
+		ptr = pool->bump;
+		pool->bump += size;
+	}
+
+	dukalloc_count_alloc(st, cls, size);
+	return ptr;
+}
+
+static void *dukalloc_alloc(void *udata, duk_size_t size) {
+	dukalloc_state *st = udata;
+
+	if (size == 0) {
+		return NULL;
+	}
+
+	st->stats.allocs++;
+	if (st->stats.mode == DUKALLOC_POOL && size <= DUKALLOC_MAX_POOLED) {
+		return dukalloc_pool_alloc(st, st->class_of[(size + 15) >> 4]);
+	}
+	return dukalloc_large_alloc(st, size);
+}
+
+static void dukalloc_free(void *udata, void *ptr) {
+	dukalloc_state *st = udata;
+	uintptr_t chunk;
+
+	if (ptr == NULL) {
+		return;
+	}
+
+	st->stats.frees++;
+	if (st->stats.mode == DUKALLOC_POOL && (chunk = dukalloc_chunk_find(st, ptr)) != 0) {
+		int cls = *(char *) chunk;
+		dukalloc_free_block *b = ptr;
+
+		b->next = st->pools[cls].free;
+		st->pools[cls].free = b;
+
+		dukalloc_count_free(st, cls, dukalloc_class_sizes[cls]);
+	} else {
+		dukalloc_header *h = (dukalloc_header *) ptr - 1;
+
+		st->stats.malloc_bytes -= h->size;
+		dukalloc_count_free(st, dukalloc_class(st, h->size), h->size);
+		free(h);
+	}
+}
+
+static void *dukalloc_realloc(void *udata, void *ptr, duk_size_t size) {
+	dukalloc_state *st = udata;
+	uintptr_t chunk;
+	void *new_ptr;
+
+	if (ptr == NULL) {
+		return dukalloc_alloc(udata, size);
+	}
+	if (size == 0) {
+		dukalloc_free(udata, ptr);
+		return NULL;
+	}
+
+	st->stats.reallocs++;
+	if (st->stats.mode == DUKALLOC_POOL && (chunk = dukalloc_chunk_find(st, ptr)) != 0) {
+		int cls = *(char *) chunk;
+		size_t old_size = dukalloc_class_sizes[cls];
+
+		/* still fits (no shrinking) */
+		if (size <= old_size) {
+			return ptr;
+		}
+
+		new_ptr = dukalloc_alloc(udata, size);
+		if (new_ptr == NULL) {
+			return NULL;
+		}
+		memcpy(new_ptr, ptr, old_size);
+		st->stats.allocs--; /* counted as a realloc */
+		st->stats.frees--;
+		dukalloc_free(udata, ptr);
+		return new_ptr;
+	} else {
+		dukalloc_header *h = (dukalloc_header *) ptr - 1;
+		size_t old_size = h->size;
+
+		h = realloc(h, sizeof(dukalloc_header) + size);
+		if (h == NULL) {
+			return NULL;
+		}
+		h->size = size;
+
+		st->stats.malloc_bytes = st->stats.malloc_bytes - old_size + size;
+		dukalloc_count_resize(st, dukalloc_class(st, old_size), old_size, dukalloc_class(st, size), size);
+		return h + 1;
+	}
+}
+
+/*
+------------------------------------------------------------------------------------
+Heap creation
+*/
+
+static dukalloc_state *dukalloc_state_from_heap(duk_context *ctx) {
+	duk_memory_functions funcs;
+
+	duk_get_memory_functions(ctx, &funcs);
+	return funcs.alloc_func == dukalloc_alloc ? funcs.udata : NULL;
+}
+
+static int dukalloc_mode_from_string(const char *s, int def) {
+	if (s == NULL) {
+		return def;
+	} else if (strcmp(s, "pool") == 0) {
+		return DUKALLOC_POOL;
+	} else if (strcmp(s, "system") == 0) {
+		return DUKALLOC_SYSTEM;
+	}
+	return def;
+}
+
+void dukalloc_parse_options(dukalloc_options *opts, int *argc, const char **argv) {
+	const char *env;
+	int i, j;
+
+	opts->mode = dukalloc_mode_from_string(getenv("DUKALLOC"), DUKALLOC_SYSTEM);
+	env = getenv("DUKALLOC_STATS");
+	opts->print_stats = (env != NULL && env[0] != '\0' && strcmp(env, "0") != 0);
+
+	if (argc == NULL || argv == NULL) {
+		return;
+	}
+
+	for (i = 1, j = 1; i < *argc; i++) {
+		if (strncmp(argv[i], "--alloc=", 8) == 0) {
+			opts->mode = dukalloc_mode_from_string(argv[i] + 8, opts->mode);
+		} else if (strcmp(argv[i], "--alloc-stats") == 0) {
+			opts->print_stats = 1;
+		} else {
+			argv[j++] = argv[i];
+		}
+	}
+
+	*argc = j;
+	argv[j] = NULL;
+}
+
+duk_context *dukalloc_create_heap(const dukalloc_options *opts, duk_fatal_function fatal_handler) {
+	dukalloc_state *st;
+	duk_context *ctx;
+	size_t size;
+	int cls;
+
+	st = calloc(1, sizeof(dukalloc_state));
+	if (st == NULL) {
+		return NULL;
+	}
+
+	if (opts) {
+		st->stats.mode = opts->mode;
+		st->print_stats = opts->print_stats;
+	}
+
+	for (size = 0, cls = 0; size <= DUKALLOC_MAX_POOLED; size += 16) {
+		while (dukalloc_class_sizes[cls] < size) {
+			cls++;
+		}
+		st->class_of[size >> 4] = (unsigned char) cls;
+	}
+	for (cls = 0; cls < DUKALLOC_NUM_CLASSES; cls++) {
+		st->stats.classes[cls].size = dukalloc_class_sizes[cls];
+	}
+
+	ctx = duk_create_heap(dukalloc_alloc, dukalloc_realloc, dukalloc_free, st, fatal_handler);
+	if (ctx == NULL) {
+		free(st);
+	}
+	return ctx;
+}
+
+const dukalloc_stats *dukalloc_get_stats(duk_context *ctx) {
+	dukalloc_state *st = dukalloc_state_from_heap(ctx);
+	return st ? &st->stats : NULL;
+}
+
+void dukalloc_dump_stats(FILE *out, const dukalloc_stats *st) {
+	int i;
+
+	fprintf(out, "allocator: %s\n", st->mode == DUKALLOC_POOL ? "pool" : "system");
+	fprintf(out, "live %lu bytes, peak %lu bytes, %lu chunks (%lu bytes)\n",
+		(unsigned long) st->live_bytes, (unsigned long) st->peak_bytes,
+		st->chunks, (unsigned long) st->reserved_bytes);
+	fprintf(out, "%lu allocs, %lu reallocs, %lu frees\n", st->allocs, st->reallocs, st->frees);
+
+	fprintf(out, "%8s %12s %12s %10s %10s\n", "size", "allocs", "frees", "live", "peak");
+	for (i = 0; i <= DUKALLOC_NUM_CLASSES; i++) {
+		const dukalloc_class_stats *cs = &st->classes[i];
+		if (i == DUKALLOC_LARGE) {
+			fprintf(out, "%8s", ">1024");
+		} else {
+			fprintf(out, "%8lu", (unsigned long) cs->size);
+		}
+		fprintf(out, " %12lu %12lu %10lu %10lu\n", cs->allocs, cs->frees,
+			(unsigned long) cs->live, (unsigned long) cs->peak);
+	}
+}
+
+void dukalloc_destroy_heap(duk_context *ctx) {
+	dukalloc_state *st = dukalloc_state_from_heap(ctx);
+	size_t i;
+
+	duk_destroy_heap(ctx);
+
+	if (st == NULL) {
+		return;
+	}
+
+	if (st->print_stats) {
+		dukalloc_dump_stats(stderr, &st->stats);
+	}
+
+	for (i = 0; i < st->chunks_cap; i++) {
+		if (st->chunks[i]) {
+			dukalloc_chunk_free((void *) st->chunks[i]);
+		}
+	}
+	free(st->chunks);
+	free(st);
+}
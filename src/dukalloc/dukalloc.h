@@ -0,0 +1,69 @@
+/*
+Allocators for the Duktape host programs.
+
+* DUKALLOC_SYSTEM: malloc/realloc/free with a small size header, so that live
+  bytes can be counted
+* DUKALLOC_POOL: size-class pools carved out of 64K chunks for small
+  allocations, malloc for larger ones
+
+Both keep statistics per size class. The allocator is chosen with the
+--alloc=pool|system flag or the DUKALLOC environment variable; --alloc-stats
+or DUKALLOC_STATS=1 prints the statistics when the heap is destroyed.
+*/
+
+#ifndef _DUKALLOC_H_
+#define _DUKALLOC_H_
+
+#include <stdio.h>
+#include <duktape.h>
+
+#define DUKALLOC_SYSTEM 0
+#define DUKALLOC_POOL 1
+
+/* number of pooled size classes; one more stats entry counts larger allocations */
+#define DUKALLOC_NUM_CLASSES 12
+
+typedef struct {
+	size_t size;          /* block size (0 for allocations larger than all classes) */
+	unsigned long allocs; /* allocations made in this class */
+	unsigned long frees;
+	size_t live;          /* blocks currently in use */
+	size_t peak;
+} dukalloc_class_stats;
+
+typedef struct {
+	int mode;
+	size_t live_bytes;     /* bytes handed to Duktape (rounded up to the block size for pooled blocks) */
+	size_t peak_bytes;
+	size_t reserved_bytes; /* bytes held by pool chunks */
+	size_t malloc_bytes;   /* bytes in blocks allocated with malloc */
+	unsigned long chunks;
+	unsigned long allocs;
+	unsigned long reallocs;
+	unsigned long frees;
+	dukalloc_class_stats classes[DUKALLOC_NUM_CLASSES + 1];
+} dukalloc_stats;
+
+typedef struct {
+	int mode;
+	int print_stats;
+} dukalloc_options;
+
+/*
+Fill opts from the environment, then from --alloc=... and --alloc-stats in argv
+(which are removed from argv). argc and argv may be NULL.
+*/
+void dukalloc_parse_options(dukalloc_options *opts, int *argc, const char **argv);
+
+/* create a heap using the allocator described by opts (NULL for the defaults) */
+duk_context *dukalloc_create_heap(const dukalloc_options *opts, duk_fatal_function fatal_handler);
+
+/* statistics of a heap created with dukalloc_create_heap, NULL for other heaps */
+const dukalloc_stats *dukalloc_get_stats(duk_context *ctx);
+
+void dukalloc_dump_stats(FILE *out, const dukalloc_stats *st);
+
+/* destroy the heap and release the allocator (works for any heap) */
+void dukalloc_destroy_heap(duk_context *ctx);
+
+#endif /* _DUKALLOC_H_ */
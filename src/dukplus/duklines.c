@@ -0,0 +1,210 @@
+/*
+Block-based line reader for Duktape (see duklines.h).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <duktape.h>
+
+#include "duklines.h"
+
+/*
+Get the next line. Returns 1 and sets *line and *len (without the line
+terminator unless keep_newline is set), 0 at the end of the file and
+-1 on errors (errno is set).
+*/
+int duklines_next(FILE *f, duklines_state *s, const char **line, size_t *len, int keep_newline) {
+	size_t scanned = 0;
+
+	for (;;) {
+		char *base = s->block + s->start;
+		size_t avail = s->end - s->start;
+		char *nl = (avail > scanned) ? memchr(base + scanned, '\n', avail - scanned) : NULL;
+
+		if (nl != NULL) {
+			size_t n = (size_t) (nl - base) + 1;
+			s->start += n;
+
+			if (!keep_newline) {
+				n--;
+				if (n > 0 && base[n-1] == '\r') {
+					n--;
+				}
+			}
+
+			*line = base;
+			*len = n;
+			return 1;
+		}
+		scanned = avail;
+
+		if (s->eof) {
+			if (avail == 0) {
+				/* look again next time, the file may have grown */
+				s->eof = 0;
+				return 0;
+			}
+			s->start = s->end;
+			*line = base;
+			*len = avail;
+			return 1;
+		}
+
+		/* make room: move the partial line to the front, grow if it fills the block */
+		if (s->start > 0) {
+			memmove(s->block, base, avail);
+			s->start = 0;
+			s->end = avail;
+		}
+		if (s->end == s->cap) {
+			size_t cap = s->cap ? s->cap * 2 : DUKLINES_BLOCKSIZ;
+			char *block = realloc(s->block, cap);
+			if (block == NULL) {
+				errno = ENOMEM;
+				return -1;
+			}
+			s->block = block;
+			s->cap = cap;
+		}
+
+		size_t n = fread(s->block + s->end, 1, s->cap - s->end, f);
+		s->end += n;
+		if (n == 0) {
+			if (ferror(f)) {
+				clearerr(f);
+				return -1;
+			}
+			s->eof = 1;
+		}
+	}
+}
+
+/* give read-ahead bytes back to a seekable FILE */
+void duklines_sync(FILE *f, duklines_state *s) {
+	size_t avail = s->end - s->start;
+
+	if (avail == 0) {
+		s->start = s->end = 0;
+		s->eof = 0;
+		return;
+	}
+
+	if (fseek(f, -(long) avail, SEEK_CUR) == 0) {
+		s->start = s->end = 0;
+		s->eof = 0;
+	}
+}
+
+/* give read-ahead bytes of the reader of the object at index (if any) back to f */
+void duklines_sync_object(duk_context *ctx, duk_idx_t index, FILE *f) {
+	duklines_state *s;
+
+	duk_get_prop_string(ctx, index, DUKLINES_PROP);
+	s = duk_get_pointer(ctx, -1);
+	duk_pop(ctx);
+
+	if (s) {
+		duklines_sync(f, s);
+	}
+}
+
+/* free the reader state stored on the object at index (for finalizers) */
+void duklines_free(duk_context *ctx, duk_idx_t index) {
+	duklines_state *s;
+
+	duk_get_prop_string(ctx, index, DUKLINES_PROP);
+	s = duk_get_pointer(ctx, -1);
+	duk_pop(ctx);
+
+	if (s) {
+		free(s->block);
+		free(s);
+	}
+}
+
+/* get the reader state stored on the object at index, creating it if needed */
+duklines_state *duklines_require_state(duk_context *ctx, duk_idx_t index) {
+	duklines_state *s;
+
+	index = duk_require_normalize_index(ctx, index);
+	duk_get_prop_string(ctx, index, DUKLINES_PROP);
+	s = duk_get_pointer(ctx, -1);
+	duk_pop(ctx);
+
+	if (s == NULL) {
+		s = calloc(1, sizeof(duklines_state));
+		if (s == NULL) {
+			duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not allocate line reader");
+		}
+		duk_push_pointer(ctx, s);
+		duk_put_prop_string(ctx, index, DUKLINES_PROP);
+	}
+
+	return s;
+}
+
+static void duklines_error(duk_context *ctx) {
+	duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not read line: %s", strerror(errno));
+}
+
+/* push the next line (or null at the end of the file) */
+void duklines_push_line(duk_context *ctx, FILE *f, duklines_state *s, int keep_newline) {
+	const char *line; size_t len;
+	int res = duklines_next(f, s, &line, &len, keep_newline);
+
+	if (res < 0) {
+		duklines_error(ctx);
+	}
+
+	if (res == 0) {
+		duk_push_null(ctx);
+	} else {
+		duk_push_lstring(ctx, line, len);
+	}
+}
+
+/* push an array with up to max lines (all remaining lines if max is 0) */
+void duklines_push_array(duk_context *ctx, FILE *f, duklines_state *s, duk_uarridx_t max) {
+	const char *line; size_t len;
+	duk_uarridx_t i = 0;
+	int res = 1;
+	duk_idx_t arr_idx = duk_push_array(ctx);
+
+	while ((max == 0 || i < max) && (res = duklines_next(f, s, &line, &len, 0)) > 0) {
+		duk_push_lstring(ctx, line, len);
+		duk_put_prop_index(ctx, arr_idx, i++);
+	}
+
+	if (res < 0) {
+		duklines_error(ctx);
+	}
+}
+
+/* call the function at cb_index with every line until it returns false, return the number of lines */
+duk_uarridx_t duklines_foreach(duk_context *ctx, FILE *f, duklines_state *s, duk_idx_t cb_index) {
+	const char *line; size_t len;
+	duk_uarridx_t count = 0;
+	int res, stop = 0;
+
+	cb_index = duk_require_normalize_index(ctx, cb_index);
+	if (!duk_is_function(ctx, cb_index)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "function expected as first argument");
+	}
+
+	while (!stop && (res = duklines_next(f, s, &line, &len, 0)) > 0) {
+		duk_dup(ctx, cb_index);
+		duk_push_lstring(ctx, line, len);
+		duk_call(ctx, 1);
+		stop = duk_is_boolean(ctx, -1) && !duk_get_boolean(ctx, -1);
+		duk_pop(ctx);
+		count++;
+	}
+
+	if (!stop && res < 0) {
+		duklines_error(ctx);
+	}
+
+	return count;
+}
@@ -0,0 +1,62 @@
+/*
+Block-based line reader for Duktape.
+
+Reads a FILE in large blocks and splits lines with memchr (which the C
+libraries vectorize), pushing each line straight from the block so a script
+can read many lines per call instead of one.
+
+The block read ahead of the last returned line stays in the reader between
+calls. Byte-oriented operations (read, write, seek) must call duklines_sync
+or duklines_sync_object first, which gives the read-ahead back to the FILE
+with fseek when it is seekable. On pipes it stays in the reader and is
+returned by the next line read.
+*/
+
+#ifndef _DUKLINES_H_
+#define _DUKLINES_H_
+
+#include <stdio.h>
+#include <duktape.h>
+
+/* property holding the reader state of a file object */
+#define DUKLINES_PROP "$$lines"
+/* initial block size, grows for longer lines */
+#define DUKLINES_BLOCKSIZ (64 * 1024)
+
+typedef struct {
+	char *block;
+	size_t cap;
+	size_t start; /* first unconsumed byte */
+	size_t end;   /* end of valid data */
+	int eof;
+} duklines_state;
+
+/*
+Get the next line. Returns 1 and sets *line and *len (without the line
+terminator unless keep_newline is set), 0 at the end of the file and
+-1 on errors (errno is set).
+*/
+int duklines_next(FILE *f, duklines_state *s, const char **line, size_t *len, int keep_newline);
+
+/* give read-ahead bytes back to a seekable FILE */
+void duklines_sync(FILE *f, duklines_state *s);
+
+/* give read-ahead bytes of the reader of the object at index (if any) back to f */
+void duklines_sync_object(duk_context *ctx, duk_idx_t index, FILE *f);
+
+/* free the reader state stored on the object at index (for finalizers) */
+void duklines_free(duk_context *ctx, duk_idx_t index);
+
+/* get the reader state stored on the object at index, creating it if needed */
+duklines_state *duklines_require_state(duk_context *ctx, duk_idx_t index);
+
+/* push the next line (or null at the end of the file) */
+void duklines_push_line(duk_context *ctx, FILE *f, duklines_state *s, int keep_newline);
+
+/* push an array with up to max lines (all remaining lines if max is 0) */
+void duklines_push_array(duk_context *ctx, FILE *f, duklines_state *s, duk_uarridx_t max);
+
+/* call the function at cb_index with every line until it returns false, return the number of lines */
+duk_uarridx_t duklines_foreach(duk_context *ctx, FILE *f, duklines_state *s, duk_idx_t cb_index);
+
+#endif /* _DUKLINES_H_ */
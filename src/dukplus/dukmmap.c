@@ -0,0 +1,158 @@
+/*
+Memory-mapped files for Duktape (see dukmmap.h).
+*/
+
+#include <stddef.h>
+#include <errno.h>
+#include <duktape.h>
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#include "dukmmap.h"
+
+/*
+Map the file at path. On success returns 0 and sets *out_ptr and *out_len
+(NULL and 0 for empty files), on failure returns -1 and sets errno.
+*/
+int dukmmap_map(const char *path, void **out_ptr, size_t *out_len) {
+#if defined(_WIN32)
+	HANDLE file, mapping;
+	LARGE_INTEGER size;
+	void *ptr;
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		errno = (GetLastError() == ERROR_FILE_NOT_FOUND || GetLastError() == ERROR_PATH_NOT_FOUND) ? ENOENT : EACCES;
+		return -1;
+	}
+
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		errno = EIO;
+		return -1;
+	}
+
+	if (size.QuadPart == 0) {
+		CloseHandle(file);
+		*out_ptr = NULL;
+		*out_len = 0;
+		return 0;
+	}
+
+	mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL) {
+		errno = EIO;
+		return -1;
+	}
+
+	/* the view keeps the mapping alive */
+	ptr = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(mapping);
+	if (ptr == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	*out_ptr = ptr;
+	*out_len = (size_t) size.QuadPart;
+	return 0;
+#else
+	struct stat st;
+	void *ptr;
+	int fd, err;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (fstat(fd, &st) != 0) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	if (!S_ISREG(st.st_mode)) {
+		close(fd);
+		errno = S_ISDIR(st.st_mode) ? EISDIR : ENODEV;
+		return -1;
+	}
+
+	if (st.st_size == 0) {
+		close(fd);
+		*out_ptr = NULL;
+		*out_len = 0;
+		return 0;
+	}
+
+	ptr = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	err = errno;
+	close(fd); /* the mapping keeps the file referenced */
+	if (ptr == MAP_FAILED) {
+		errno = err;
+		return -1;
+	}
+
+	*out_ptr = ptr;
+	*out_len = (size_t) st.st_size;
+	return 0;
+#endif
+}
+
+void dukmmap_unmap(void *ptr, size_t len) {
+	if (ptr == NULL) {
+		return;
+	}
+#if defined(_WIN32)
+	(void) len;
+	UnmapViewOfFile(ptr);
+#else
+	munmap(ptr, len);
+#endif
+}
+
+static duk_ret_t dukmmap_finalizer(duk_context *ctx) {
+	void *ptr;
+	duk_size_t len;
+
+	duk_get_prop_string(ctx, 0, DUKMMAP_PROP);
+	ptr = duk_get_buffer(ctx, -1, &len);
+
+	/* detach first so stray references to the plain buffer see zero bytes */
+	if (duk_is_buffer(ctx, -1)) {
+		duk_config_buffer(ctx, -1, NULL, 0);
+	}
+	dukmmap_unmap(ptr, len);
+
+	return 0;
+}
+
+/*
+Push a Node.js Buffer viewing the mapping. The mapping is owned by the buffer
+and released by its finalizer.
+*/
+void dukmmap_push_buffer(duk_context *ctx, void *ptr, size_t len) {
+	duk_push_external_buffer(ctx);
+	duk_config_buffer(ctx, -1, ptr, len);
+
+	duk_push_buffer_object(ctx, -1, 0, len, DUK_BUFOBJ_NODEJS_BUFFER);
+
+	duk_dup(ctx, -2);
+	duk_put_prop_string(ctx, -2, DUKMMAP_PROP);
+
+	duk_push_c_function(ctx, dukmmap_finalizer, 1);
+	duk_set_finalizer(ctx, -2);
+
+	duk_remove(ctx, -2); /* remove the plain buffer */
+}
@@ -0,0 +1,33 @@
+/*
+Memory-mapped files for Duktape.
+
+Maps a whole file copy-on-write so that it can be exposed to scripts as a
+buffer without reading it into the heap first. Writes to the buffer never
+reach the file. Truncating the file while it is mapped makes accesses past
+the new end fault, like with any other mapping.
+*/
+
+#ifndef _DUKMMAP_H_
+#define _DUKMMAP_H_
+
+#include <stddef.h>
+#include <duktape.h>
+
+/* property of the buffer object holding the external plain buffer */
+#define DUKMMAP_PROP "$$mmap"
+
+/*
+Map the file at path. On success returns 0 and sets *out_ptr and *out_len
+(NULL and 0 for empty files), on failure returns -1 and sets errno.
+*/
+int dukmmap_map(const char *path, void **out_ptr, size_t *out_len);
+
+void dukmmap_unmap(void *ptr, size_t len);
+
+/*
+Push a Node.js Buffer viewing the mapping. The mapping is owned by the buffer
+and released by its finalizer.
+*/
+void dukmmap_push_buffer(duk_context *ctx, void *ptr, size_t len);
+
+#endif /* _DUKMMAP_H_ */
@@ -8,8 +8,12 @@ define BUILD_AS_DLL to build as a duktape module.
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <duktape.h>
 
+#include "dukmmap.h"
+#include "duklines.h"
+
 // #define DEBUG /* activate debug mode */
 
 #if !defined(duk_checkmode)
@@ -31,8 +35,6 @@ define BUILD_AS_DLL to build as a duktape module.
 #define FILENAME_PROP "path"
 /* Name of the dukioFile prototype */
 #define DUKIOFILE_PROTOTYPE "DukioFilePrototype"
-/* File reading buffer size */
-#define DUKIO_BUFSIZ 512
 
 
 /* get filehandle from object */
@@ -58,6 +60,16 @@ static FILE* dukio_file_from_this(duk_context *ctx) {
 	return f;
 }
 
+/* get filehandle from 'this' for byte-oriented operations (gives back line read-ahead) */
+static FILE* dukio_file_for_bytes(duk_context *ctx) {
+	FILE *f;
+	duk_push_this(ctx);
+	f = dukio_require_file(ctx, -1);
+	duklines_sync_object(ctx, -1, f);
+	duk_pop(ctx);
+	return f;
+}
+
 static void dukio_push(duk_context *ctx, FILE *f, const char *filename) {
 	/* create object with dukioFile prototype */
 	duk_push_object(ctx);
@@ -79,6 +91,7 @@ static duk_ret_t dukio_file_finalizer(duk_context *ctx) {
 	printf("%s\n", "calling dukio file finalizer");
 	#endif
 
+	duklines_free(ctx, 0);
 	FILE *f = dukio_require_file(ctx, 0);
 	fclose(f);
 
@@ -118,7 +131,7 @@ static duk_ret_t dukio_open(duk_context *ctx) {
 }
 
 static duk_ret_t dukio_rewind(duk_context *ctx) {
-	FILE *f = dukio_file_from_this(ctx);
+	FILE *f = dukio_file_for_bytes(ctx);
 
 	rewind(f);
 
@@ -137,18 +150,39 @@ static duk_ret_t dukio_size(duk_context *ctx) {
 	return 1;
 }
 
+/* file.gets () : reads a line including its newline, null at the end of the file */
 static duk_ret_t dukio_gets(duk_context *ctx) {
 	FILE *f = dukio_file_from_this(ctx);
-	char buffer[DUKIO_BUFSIZ];
 
-	fgets(buffer, DUKIO_BUFSIZ, f);
+	duk_push_this(ctx);
+	duklines_push_line(ctx, f, duklines_require_state(ctx, -1), 1);
+	return 1;
+}
+
+/* file.readLines ([max]) : reads up to max lines (all by default) into an array */
+static duk_ret_t dukio_readlines(duk_context *ctx) {
+	FILE *f = dukio_file_from_this(ctx);
+	duk_uarridx_t max = duk_is_number(ctx, 0) ? (duk_uarridx_t) duk_require_uint(ctx, 0) : 0;
 
-	duk_push_string(ctx, buffer);
+	duk_push_this(ctx);
+	duklines_push_array(ctx, f, duklines_require_state(ctx, -1), max);
 	return 1;
 }
 
-static duk_ret_t dukio_puts(duk_context *ctx) {
+/* file.forEachLine (callback) : calls callback(line) until the end of the file or until it returns false */
+static duk_ret_t dukio_foreachline(duk_context *ctx) {
 	FILE *f = dukio_file_from_this(ctx);
+	duk_uarridx_t count;
+
+	duk_push_this(ctx);
+	count = duklines_foreach(ctx, f, duklines_require_state(ctx, -1), 0);
+
+	duk_push_uint(ctx, count);
+	return 1;
+}
+
+static duk_ret_t dukio_puts(duk_context *ctx) {
+	FILE *f = dukio_file_for_bytes(ctx);
 	const char *s = duk_require_string(ctx, 0);
 
 	fputs(s, f);
@@ -157,7 +191,7 @@ static duk_ret_t dukio_puts(duk_context *ctx) {
 }
 
 static duk_ret_t dukio_read(duk_context *ctx) {
-	FILE *f = dukio_file_from_this(ctx);
+	FILE *f = dukio_file_for_bytes(ctx);
 	long byten = duk_require_int(ctx, 0);
 
 	#ifdef DEBUG
@@ -175,7 +209,7 @@ static duk_ret_t dukio_read(duk_context *ctx) {
 }
 
 static duk_ret_t dukio_readall(duk_context *ctx) {
-	FILE *f = dukio_file_from_this(ctx);
+	FILE *f = dukio_file_for_bytes(ctx);
 
 	fseek(f, 0, SEEK_END);
 	long size = ftell(f);
@@ -188,7 +222,7 @@ static duk_ret_t dukio_readall(duk_context *ctx) {
 }
 
 static duk_ret_t dukio_get(duk_context *ctx) {
-	FILE *f = dukio_file_from_this(ctx);
+	FILE *f = dukio_file_for_bytes(ctx);
 
 	int c = fgetc(f);
 
@@ -197,7 +231,7 @@ static duk_ret_t dukio_get(duk_context *ctx) {
 }
 
 static duk_ret_t dukio_getc(duk_context *ctx) {
-	FILE *f = dukio_file_from_this(ctx);
+	FILE *f = dukio_file_for_bytes(ctx);
 	char s[2];
 
 	int c = fgetc(f);
@@ -222,6 +256,20 @@ static duk_ret_t dukio_readfile(duk_context *ctx) {
 	return 1;
 }
 
+/* io.mapFile (filename) : maps the file into a buffer instead of reading it */
+static duk_ret_t dukio_mapfile(duk_context *ctx) {
+	const char *filename = duk_require_string(ctx, 0);
+	void *ptr; size_t len;
+
+	if (dukmmap_map(filename, &ptr, &len)) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not map file '%s': %s", filename, strerror(errno));
+		return -1;
+	}
+
+	dukmmap_push_buffer(ctx, ptr, len);
+	return 1;
+}
+
 static duk_ret_t dukio_writefile(duk_context *ctx) {
 	const char *filename = duk_require_string(ctx, 0);
 	FILE *f = fopen(filename, "wb+");
@@ -257,6 +305,8 @@ static duk_ret_t dukio_exists(duk_context *ctx) {
 static const duk_function_list_entry dukio_file_prototype[] = {
 	{ "rewind", dukio_rewind, 0},
 	{ "gets", dukio_gets, 0 },
+	{ "readLines", dukio_readlines, 1 },
+	{ "forEachLine", dukio_foreachline, 1 },
 	{ "puts", dukio_puts, 1},
 	{ "read", dukio_read, 1},
 	{ "readAll", dukio_readall, 0},
@@ -269,6 +319,7 @@ static const duk_function_list_entry dukio_file_prototype[] = {
 static const duk_function_list_entry dukio_module[] = {
 	{ "open", dukio_open, 2 },
 	{ "readFile", dukio_readfile, 1 },
+	{ "mapFile", dukio_mapfile, 1 },
 	{ "writeFile", dukio_writefile, 2},
 	{ "exists", dukio_exists, 1 },
 	{ NULL, NULL, 0}
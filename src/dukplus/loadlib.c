@@ -26,6 +26,35 @@ Heavily based on the loadlib.c file of Lua 5.2.3.
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <ctype.h>
+#include <io.h>
+#include <process.h>
+#define duk_access(path) _access(path, 4)
+#define duk_getpid _getpid
+#else
+#include <unistd.h>
+#include <dirent.h>
+#define duk_access(path) access(path, R_OK)
+#define duk_getpid getpid
+#endif
+
+/* sub-second part of the mtime/ctime of a struct stat (0 where it is not available) */
+#if defined(__APPLE__)
+#define duk_mtime_nsec(st) ((st)->st_mtimespec.tv_nsec)
+#define duk_ctime_nsec(st) ((st)->st_ctimespec.tv_nsec)
+#elif !defined(_WIN32) && (_POSIX_C_SOURCE >= 200809L || defined(_DEFAULT_SOURCE) || defined(_GNU_SOURCE))
+#define duk_mtime_nsec(st) ((st)->st_mtim.tv_nsec)
+#define duk_ctime_nsec(st) ((st)->st_ctim.tv_nsec)
+#else
+#define duk_mtime_nsec(st) 0
+#define duk_ctime_nsec(st) 0
+#endif
 
 #ifdef DEBUG
 
@@ -41,6 +70,7 @@ Heavily based on the loadlib.c file of Lua 5.2.3.
 
 #include <duktape.h>
 
+#include "dukmmap.h"
 
 
 /*
@@ -59,6 +89,20 @@ Heavily based on the loadlib.c file of Lua 5.2.3.
 #define DUK_CPATH	"DUK_CPATH"
 #endif
 
+/*
+** DUK_BYTECODE is the name of the environment variable that enables
+** the bytecode cache of JavaScript modules (any value but 0); scripts
+** can also set package.bytecode.
+** DUK_BYTECODE_EXT is appended to a module path to get its cache file.
+*/
+#if !defined(DUK_BYTECODE)
+#define DUK_BYTECODE	"DUK_BYTECODE"
+#endif
+
+#if !defined(DUK_BYTECODE_EXT)
+#define DUK_BYTECODE_EXT	".dukc"
+#endif
+
 
 /*
 ** LUA_CSUBSEP is the character that replaces dots in submodule names
@@ -94,6 +138,10 @@ Heavily based on the loadlib.c file of Lua 5.2.3.
 /* table containing the 'preloaded' (internal in the application) modules */
 #define PRELOAD_TABLE "$PRELOAD"
 
+/* tables (in the package object) caching module resolution and directory listings */
+#define RESOLVED	"$$RESOLVED"
+#define DIRS		"$$DIRS"
+
 /* handle for dynamic library objects */
 #define DUK_LIB_HANDLE "$data"
 
@@ -169,16 +217,16 @@ static void duk_unloadlib (void *lib) {
 }
 
 
-static void *duk_load (lua_State *L, const char *path, int seeglb) {
+static void *duk_load (duk_context *ctx, const char *path, int seeglb) {
   void *lib = dlopen(path, RTLD_NOW | (seeglb ? RTLD_GLOBAL : RTLD_LOCAL));
-  if (lib == NULL) duk_error(ctx, DUK_ERR_INTERNAL_ERROR, dlerror());
+  if (lib == NULL) duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "%s", dlerror());
   return lib;
 }
 
 
-static duk_c_function duk_sym (lua_State *L, void *lib, const char *sym) {
+static duk_c_function duk_sym (duk_context *ctx, void *lib, const char *sym) {
   duk_c_function f = (duk_c_function)dlsym(lib, sym);
-  if (f == NULL) duk_error(ctx, DUK_ERR_INTERNAL_ERROR, dlerror());
+  if (f == NULL) duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "%s", dlerror());
   return f;
 }
 
@@ -282,10 +330,7 @@ duk_ret_t duk_loadlib (duk_context *ctx) {
 */
 
 static int readable (const char *filename) {
-  FILE *f = fopen(filename, "r");  /* try to open file */
-  if (f == NULL) return 0;  /* open failed */
-  fclose(f);
-  return 1;
+  return duk_access(filename) == 0;  /* no need to open the file */
 }
 
 static duk_ret_t duk_readable (duk_context *ctx) {
@@ -294,29 +339,331 @@ static duk_ret_t duk_readable (duk_context *ctx) {
   return 1;
 }
 
-static duk_ret_t duk_read_file (duk_context *ctx) {
+/*
+** {======================================================
+** Module resolution cache
+**
+** package.searchPath(id, pathlist) remembers its result per pathlist
+** and id, also when nothing was found. Candidates are checked against a
+** listing of their directory, read once per directory, so repeated and
+** failed lookups do not touch the disk. package.clearCache() forgets
+** everything (e.g. after creating modules at runtime).
+** =======================================================
+*/
 
-  FILE *f = fopen(duk_require_string(ctx, 0), "rb");
-  fseek(f, 0, SEEK_END);
-  long fsize = ftell(f);
-  fseek(f, 0, SEEK_SET);
+/* push an object with the names of the non-directory entries of dir, or false */
+static void duk_push_dir_listing (duk_context *ctx, const char *dir) {
+#if defined(_WIN32)
+  WIN32_FIND_DATAA fd;
+  HANDLE h;
+
+  duk_push_sprintf(ctx, "%s/*", dir);
+  h = FindFirstFileA(duk_get_string(ctx, -1), &fd);
+  duk_pop(ctx);
+  if (h == INVALID_HANDLE_VALUE) {
+    duk_push_false(ctx);
+    return;
+  }
 
-#if defined(__GNUC__) && !defined(DUK_NO_VLA)
-  char inbuff[fsize + 1];
+  duk_push_object(ctx);
+  do {
+    if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+    CharLowerA(fd.cFileName);  /* file names are case insensitive */
+    duk_push_true(ctx);
+    duk_put_prop_string(ctx, -2, fd.cFileName);
+  } while (FindNextFileA(h, &fd));
+  FindClose(h);
 #else
-  char *inbuff = (char*) malloc(fsize + 1);
+  DIR *d = opendir(dir);
+  struct dirent *ent;
+
+  if (d == NULL) {
+    duk_push_false(ctx);
+    return;
+  }
+
+  duk_push_object(ctx);
+  while ((ent = readdir(d)) != NULL) {
+#if defined(DT_DIR)
+    if (ent->d_type == DT_DIR) continue;
 #endif
-  fread(inbuff, fsize, 1, f);
-  fclose(f);
-  inbuff[fsize] = 0;
+    duk_push_true(ctx);
+    duk_put_prop_string(ctx, -2, ent->d_name);
+  }
+  closedir(d);
+#endif
+}
 
-  duk_push_string(ctx, inbuff);
-#if !defined(__GNUC__) || defined(DUK_NO_VLA)
-  free(inbuff);
+/* check if the file at the top of the stack exists using the listing cache at dirs_idx */
+static int duk_cached_exists (duk_context *ctx, duk_idx_t dirs_idx) {
+  duk_size_t len, i;
+  const char *path = duk_get_lstring(ctx, -1, &len);
+  int found;
+
+  for (i = len; i > 0 && path[i-1] != '/' && path[i-1] != '\\'; i--);
+  if (i == len) return 0;  /* no file name */
+
+  if (i == 0) duk_push_string(ctx, ".");
+  else if (i == 1) duk_push_lstring(ctx, path, 1);  /* root */
+  else duk_push_lstring(ctx, path, i - 1);
+
+  if (!duk_get_prop_string(ctx, dirs_idx, duk_get_string(ctx, -1))) {
+    duk_pop(ctx);
+    duk_push_dir_listing(ctx, duk_get_string(ctx, -1));
+    duk_dup_top(ctx);
+    duk_put_prop_string(ctx, dirs_idx, duk_get_string(ctx, -3));
+  }
+
+  found = 0;
+  if (duk_is_object(ctx, -1)) {
+#if defined(_WIN32)
+    duk_size_t k;
+    char *lower = duk_push_fixed_buffer(ctx, len - i);
+    for (k = 0; k < len - i; k++) lower[k] = (char) tolower((unsigned char) path[i + k]);
+    duk_to_string(ctx, -1);
+#else
+    duk_push_lstring(ctx, path + i, len - i);
 #endif
+    found = duk_has_prop(ctx, -2);
+  }
+  duk_pop_2(ctx);  /* pop directory and listing */
+
+  return found;
+}
+
+/* package.searchPath(id, pathlist) : first readable template of pathlist with ? replaced by id, or null */
+static duk_ret_t duk_search_path (duk_context *ctx) {
+  const char *id = duk_require_string(ctx, 0);
+  const char *pathlist = duk_require_string(ctx, 1);
+  const char *p, *q;
+
+  duk_get_global_string(ctx, "package");  /* 2 */
+  duk_get_prop_string(ctx, 2, RESOLVED);  /* 3 */
+  duk_get_prop_string(ctx, 2, DIRS);      /* 4 */
+
+  /* results = RESOLVED[pathlist] */
+  if (!duk_get_prop_string(ctx, 3, pathlist)) {
+    duk_pop(ctx);
+    duk_push_object(ctx);
+    duk_dup_top(ctx);
+    duk_put_prop_string(ctx, 3, pathlist);
+  }                                       /* 5 */
+
+  if (duk_get_prop_string(ctx, 5, id)) return 1;  /* cached, null if not found */
+  duk_pop(ctx);
+
+  for (p = pathlist; *p != '\0'; p = (*q == ';') ? q + 1 : q) {
+    duk_idx_t parts = 0;
+
+    for (q = p; *q != '\0' && *q != ';'; q++);
+    if (q == p) continue;
+
+    /* template with every ? replaced by id */
+    while (p < q) {
+      const char *mark = memchr(p, '?', q - p);
+      if (mark == NULL) mark = q;
+      duk_push_lstring(ctx, p, mark - p);
+      parts++;
+      if (mark < q) {
+        duk_push_string(ctx, id);
+        parts++;
+        mark++;
+      }
+      p = mark;
+    }
+    duk_concat(ctx, parts);
+
+    if (duk_cached_exists(ctx, 4)) {
+      duk_dup_top(ctx);
+      duk_put_prop_string(ctx, 5, id);
+      return 1;
+    }
+    duk_pop(ctx);
+  }
+
+  duk_push_null(ctx);
+  duk_put_prop_string(ctx, 5, id);
+  duk_push_null(ctx);
   return 1;
 }
 
+/* package.clearCache() : forgets resolved modules and directory listings */
+static duk_ret_t duk_clear_cache (duk_context *ctx) {
+  duk_get_global_string(ctx, "package");
+  duk_push_object(ctx);
+  duk_put_prop_string(ctx, -2, RESOLVED);
+  duk_push_object(ctx);
+  duk_put_prop_string(ctx, -2, DIRS);
+  return 0;
+}
+
+static duk_ret_t duk_read_file (duk_context *ctx) {
+  const char *filename = duk_require_string(ctx, 0);
+  void *src; size_t len;
+
+  /* map the source so it is copied only once, straight into the string */
+  if (dukmmap_map(filename, &src, &len))
+    duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not read file: %s", filename);
+
+  duk_push_lstring(ctx, (const char *) src, len);
+  dukmmap_unmap(src, len);
+  return 1;
+}
+
+/*
+** {======================================================
+** Bytecode cache for JavaScript modules
+**
+** The module wrapper function is compiled the same way Duktape's
+** require() does it and dumped next to the source. A cache file is only
+** used if its header matches the source path, mtime and ctime (with
+** nanoseconds where the platform has them), size and the engine version;
+** otherwise it is rebuilt (if the directory is writable). The cache is
+** off by default since it writes next to the modules, see DUK_BYTECODE.
+** =======================================================
+*/
+
+#if defined(DUK_USE_BYTECODE_DUMP_SUPPORT)
+
+typedef struct {
+  char magic[4];
+  uint32_t version;  /* DUK_VERSION */
+  uint32_t ptrsize;  /* bytecode is not portable between builds */
+  uint32_t pathlen;  /* the path follows the header, then the bytecode */
+  int64_t mtime;
+  int64_t mtime_nsec;
+  int64_t ctime;     /* changes on every write, even if the mtime is restored */
+  int64_t ctime_nsec;
+  int64_t size;
+} duk_bc_header;
+
+#define DUK_BC_MAGIC "DUKC"
+
+static void duk_bc_fill_header (duk_bc_header *h, const char *path, struct stat *st) {
+  memset(h, 0, sizeof(duk_bc_header));
+  memcpy(h->magic, DUK_BC_MAGIC, 4);
+  h->version = (uint32_t) DUK_VERSION;
+  h->ptrsize = (uint32_t) sizeof(void *);
+  h->pathlen = (uint32_t) strlen(path);
+  h->mtime = (int64_t) st->st_mtime;
+  h->mtime_nsec = (int64_t) duk_mtime_nsec(st);
+  h->ctime = (int64_t) st->st_ctime;
+  h->ctime_nsec = (int64_t) duk_ctime_nsec(st);
+  h->size = (int64_t) st->st_size;
+}
+
+/* push the module function from the cache file, returns 0 if it is missing or stale */
+static int duk_bc_load (duk_context *ctx, const char *cachepath, const char *path, duk_bc_header *expected) {
+  void *data; size_t len;
+  size_t offset = sizeof(duk_bc_header) + expected->pathlen;
+
+  if (dukmmap_map(cachepath, &data, &len)) return 0;
+
+  if (len <= offset || memcmp(data, expected, sizeof(duk_bc_header)) != 0 ||
+      memcmp((char *) data + sizeof(duk_bc_header), path, expected->pathlen) != 0) {
+    dukmmap_unmap(data, len);
+    return 0;
+  }
+
+  /* load straight from the mapping, duk_load_function copies what it needs */
+  duk_push_external_buffer(ctx);
+  duk_config_buffer(ctx, -1, (char *) data + offset, len - offset);
+  duk_load_function(ctx);
+  dukmmap_unmap(data, len);
+  return 1;
+}
+
+/* dump the function at the top of the stack to the cache file, failures are ignored */
+static void duk_bc_save (duk_context *ctx, const char *cachepath, const char *path, duk_bc_header *h) {
+  void *bc; duk_size_t bclen;
+  const char *tmppath;
+  FILE *f;
+  int ok;
+
+  /* write to a temporary file and rename it, so concurrent loaders never see a partial file */
+  duk_push_sprintf(ctx, "%s.%lu.tmp", cachepath, (unsigned long) duk_getpid());
+  tmppath = duk_get_string(ctx, -1);
+
+  duk_dup(ctx, -2);
+  duk_dump_function(ctx);
+  bc = duk_get_buffer(ctx, -1, &bclen);
+
+  f = fopen(tmppath, "wb");
+  if (f != NULL) {
+    ok = fwrite(h, sizeof(duk_bc_header), 1, f) == 1 &&
+         fwrite(path, 1, h->pathlen, f) == h->pathlen &&
+         fwrite(bc, 1, bclen, f) == bclen;
+    ok = (fclose(f) == 0) && ok;
+    if (ok) {
+#if defined(_WIN32)
+      ok = MoveFileExA(tmppath, cachepath, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+      ok = rename(tmppath, cachepath) == 0;
+#endif
+    }
+    if (!ok) remove(tmppath);
+  }
+
+  duk_pop_2(ctx);
+}
+
+#endif
+
+/* package.loadModule(path, id, require, exports, module) : runs a JavaScript module using the bytecode cache */
+static duk_ret_t duk_load_module (duk_context *ctx) {
+  const char *path = duk_require_string(ctx, 0);
+  void *src; size_t len;
+
+#if defined(DUK_USE_BYTECODE_DUMP_SUPPORT)
+  struct stat st;
+  duk_bc_header h;
+  const char *cachepath;
+  int have_stat = stat(path, &st) == 0;
+
+  duk_push_string(ctx, path);
+  duk_push_string(ctx, DUK_BYTECODE_EXT);
+  duk_concat(ctx, 2);
+  cachepath = duk_get_string(ctx, -1);  /* [ ... cachepath ] */
+
+  if (have_stat) duk_bc_fill_header(&h, path, &st);
+  if (!have_stat || !duk_bc_load(ctx, cachepath, path, &h)) {
+#endif
+    if (dukmmap_map(path, &src, &len))
+      duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not read file: %s", path);
+
+    /* same wrapper and fileName as Duktape's require() */
+    duk_push_string(ctx, "(function(require,exports,module){");
+    duk_push_lstring(ctx, (const char *) src, len);
+    dukmmap_unmap(src, len);
+    duk_push_string(ctx, "})");
+    duk_concat(ctx, 3);
+    duk_dup(ctx, 1);
+    duk_eval_raw(ctx, NULL, 0, DUK_COMPILE_EVAL);
+
+#if defined(DUK_USE_BYTECODE_DUMP_SUPPORT)
+    if (have_stat) duk_bc_save(ctx, cachepath, path, &h);
+  }
+#endif
+
+  /* mod_func.call(exports, require, exports, module) */
+  duk_dup(ctx, 3);
+  duk_dup(ctx, 2);
+  duk_dup(ctx, 3);
+  duk_dup(ctx, 4);
+  duk_call_method(ctx, 3);
+  return 0;
+}
+
+static int default_bytecode() {
+  char *env = getenv(DUK_BYTECODE);
+#if defined(DUK_USE_BYTECODE_DUMP_SUPPORT)
+  return env != NULL && strcmp(env, "0") != 0;
+#else
+  (void) env;
+  return 0;
+#endif
+}
+
 static const char *default_jpath() {
   char *jpath = getenv(DUK_PATH);
   if (jpath) { return jpath; }
@@ -333,13 +680,13 @@ static const char *default_cpath() {
 
 static char _modsearch_src[] = "Duktape.modSearch = function (id, require, exports, module) {" "function extend(from, to) {" \
     "for (var key in from) { if (from.hasOwnProperty(key) && !to.hasOwnProperty(key)) { to[key] = from[key] } } " \
-  "}" "function searchPath(pathlist) {"   "pathlist = pathlist.replace(/\\?/g, id); " \
-    "pathlist = pathlist.split(';');"   "for (var i = 0; i < pathlist.length; i++) {" \
-      "var path = pathlist[i]; if (package.exists(path)) { return path; }"     "}"     "return null;" \
+  "}" "function searchPath(pathlist) {"   "return package.searchPath(id, pathlist);" \
   "}"     "if (package.preload[id]) { var pr = package.preload[id]; if (typeof pr == 'string') { return pr; } else { extend(package.preload[id], exports); return undefined;} }" \
     "var found = searchPath(package.cpath);"     "if (found) {"       "var mod = package.loadlib(id, found)();" \
       "extend(mod, exports); return undefined;"     "}" \
-    "var found = searchPath(package.path);"     "if (found) {"       "return package.readFile(found);" \
+    "var found = searchPath(package.path);"     "if (found) {" \
+      "if (package.bytecode) { package.loadModule(found, id, require, exports, module); return undefined; }" \
+      "return package.readFile(found);" \
     "}"     "throw new Error('module not found: ' + id);" "}";
 
 void register_mod_search(duk_context *ctx) {
@@ -362,12 +709,30 @@ void register_mod_search(duk_context *ctx) {
   duk_push_c_function(ctx, duk_readable, 1); /* exists function */
   duk_put_prop_string(ctx, pkg_obj, "exists");
 
+  duk_push_object(ctx); /* resolution cache (empty) */
+  duk_put_prop_string(ctx, pkg_obj, RESOLVED);
+
+  duk_push_object(ctx); /* directory listing cache (empty) */
+  duk_put_prop_string(ctx, pkg_obj, DIRS);
+
+  duk_push_c_function(ctx, duk_search_path, 2); /* searchPath function */
+  duk_put_prop_string(ctx, pkg_obj, "searchPath");
+
+  duk_push_c_function(ctx, duk_clear_cache, 0); /* clearCache function */
+  duk_put_prop_string(ctx, pkg_obj, "clearCache");
+
   duk_push_c_function(ctx, duk_loadlib, 2); /* loadlib function */
   duk_put_prop_string(ctx, pkg_obj, "loadlib");
 
   duk_push_c_function(ctx, duk_read_file, 1); /* readFile function */
   duk_put_prop_string(ctx, pkg_obj, "readFile");
 
+  duk_push_boolean(ctx, default_bytecode()); /* use the bytecode cache */
+  duk_put_prop_string(ctx, pkg_obj, "bytecode");
+
+  duk_push_c_function(ctx, duk_load_module, 5); /* loadModule function */
+  duk_put_prop_string(ctx, pkg_obj, "loadModule");
+
   duk_put_global_string(ctx, "package"); /* register package table */
 
   // -----------------------------------------------------------------------------------------------
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include "duktape.h"
+#include "../dukalloc/dukalloc.h"
 
 void register_mod_search(duk_context *ctx);
 void register_dukio(duk_context *ctx);
@@ -9,8 +10,10 @@ void prepare_duk_env(duk_context *ctx);
 
 int main(int argc, const char *argv[]) {
     duk_context *ctx = NULL;
+    dukalloc_options alloc_opts;
 
-    ctx = duk_create_heap_default();
+    dukalloc_parse_options(&alloc_opts, &argc, argv);
+    ctx = dukalloc_create_heap(&alloc_opts, NULL);
     if (!ctx) {
         printf("Failed to create a Duktape heap.\n");
         exit(1);
@@ -25,7 +28,7 @@ int main(int argc, const char *argv[]) {
     duk_pop(ctx);  /* ignore result */
 
  finished:
-    duk_destroy_heap(ctx);
+    dukalloc_destroy_heap(ctx);
 
     exit(0);
 }
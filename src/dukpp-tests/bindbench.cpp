@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "duk.hpp"
+
+/*
+Micro-benchmark of bound object overhead: the lookups dukbinder used to do
+(prototype from a global, native pointer from a "$$data" property) against
+the cached heap pointers it uses now, and the DUKPP_BIND trampolines
+(built as C++11 to keep the macros compiling).
+*/
+
+#define BENCH_ITERATIONS 2000000
+
+struct Counter {
+	int count;
+	Counter() : count(0) {}
+	int increment() { return ++count; }
+};
+
+/* a second bound class (shares the handle key with Counter) */
+struct Gauge {
+	double level;
+	Gauge() : level(0.0) {}
+};
+
+/*
+---------------------------------------------------
+Previous lookups
+*/
+
+static Counter* legacy_get(duk_context *ctx, duk_idx_t index) {
+	Counter *result;
+	duk_get_prop_string(ctx, index, "$$data");
+	result = static_cast<Counter*>(duk_get_pointer(ctx, -1));
+	duk_pop(ctx);
+	return result;
+}
+
+static duk_bool_t legacy_is(duk_context *ctx, duk_idx_t index) {
+	duk_bool_t result;
+	duk_get_prototype(ctx, index);
+	duk_get_global_string(ctx, "$LegacyCounterPrototype");
+	result = duk_equals(ctx, -1, -2);
+	duk_pop_2(ctx);
+	return result;
+}
+
+static duk_ret_t legacy_constructor(duk_context *ctx) {
+	duk_push_this(ctx);
+	duk_get_global_string(ctx, "$LegacyCounterPrototype");
+	duk_set_prototype(ctx, -2);
+	duk_push_pointer(ctx, new Counter());
+	duk_put_prop_string(ctx, -2, "$$data");
+	return 1;
+}
+
+static duk_ret_t legacy_finalizer(duk_context *ctx) {
+	delete legacy_get(ctx, 0);
+	return 0;
+}
+
+static duk_ret_t legacy_increment(duk_context *ctx) {
+	Counter *c;
+	duk_push_this(ctx);
+	if (!legacy_is(ctx, -1)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "Expected LegacyCounter");
+	}
+	c = legacy_get(ctx, -1);
+	duk_push_int(ctx, ++c->count);
+	return 1;
+}
+
+static const duk_function_list_entry legacy_prototype[] = {
+	{ "increment", legacy_increment, 0 },
+	{ NULL, NULL, 0 }
+};
+
+/*
+---------------------------------------------------
+dukbinder
+*/
+
+static duk_ret_t counter_increment(duk_context *ctx) {
+	Counter *c;
+	duk_push_this(ctx);
+	c = dukbinder_check<Counter>(ctx, -1);
+	duk_push_int(ctx, ++c->count);
+	return 1;
+}
+
+static const duk_function_list_entry counter_prototype[] = {
+	{ "increment", counter_increment, 0 },
+	{ "incrementBound", DUKPP_BIND(&Counter::increment), DUKPP_BIND_NARGS(&Counter::increment) },
+	{ NULL, NULL, 0 }
+};
+
+static const duk_function_list_entry gauge_prototype[] = {
+	{ NULL, NULL, 0 }
+};
+
+/*
+---------------------------------------------------
+Benchmark
+*/
+
+static void test_register(duk_context *ctx) {
+	duk_push_object(ctx);
+	duk_push_c_function(ctx, legacy_finalizer, 1);
+	duk_set_finalizer(ctx, -2);
+	duk_put_function_list(ctx, -1, legacy_prototype);
+	duk_put_global_string(ctx, "$LegacyCounterPrototype");
+
+	duk_push_c_function(ctx, legacy_constructor, 0);
+	duk_put_global_string(ctx, "LegacyCounter");
+
+	dukbinder_register<Counter>(ctx, "Counter", "$CounterPrototype", counter_prototype);
+	dukbinder_register<Gauge>(ctx, "Gauge", "$GaugePrototype", gauge_prototype);
+}
+
+static void run(duk_context *ctx, const char *name, const char *code) {
+	clock_t start = clock();
+
+	duk_push_int(ctx, BENCH_ITERATIONS);
+	duk_put_global_string(ctx, "iterations");
+
+	if (duk_peval_string(ctx, code) != 0) {
+		printf("ERROR: %s\n", duk_safe_to_string(ctx, -1));
+	}
+	duk_pop(ctx);
+
+	printf("%-32s %8.1f ms\n", name, (double) (clock() - start) * 1000.0 / CLOCKS_PER_SEC);
+}
+
+int main(int argc, char const *argv[]) {
+	duk_context *ctx = duk_create_heap_default();
+
+	if (!ctx) {
+		printf("Failed to create a Duktape heap.\n");
+		exit(1);
+	}
+
+	test_register(ctx);
+
+	printf("%d iterations\n", BENCH_ITERATIONS);
+	run(ctx, "method calls (legacy)", "var c = new LegacyCounter(); for (var i = 0; i < iterations; i++) { c.increment(); }");
+	run(ctx, "method calls (dukbinder)", "var c = new Counter(); for (var i = 0; i < iterations; i++) { c.increment(); }");
+	run(ctx, "method calls (DUKPP_BIND)", "var c = new Counter(); for (var i = 0; i < iterations; i++) { c.incrementBound(); }");
+	run(ctx, "wrong 'this' (DUKPP_BIND)", "try { new Counter().incrementBound.call(new Gauge()); } catch (e) { print(e); }");
+	run(ctx, "object creation (legacy)", "for (var i = 0; i < iterations / 10; i++) { new LegacyCounter(); }");
+	run(ctx, "object creation (dukbinder)", "for (var i = 0; i < iterations / 10; i++) { new Counter(); }");
+
+	duk_destroy_heap(ctx);
+	return 0;
+}
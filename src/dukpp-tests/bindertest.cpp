@@ -5,7 +5,7 @@
 #include "file.hpp"
 
 const char script[] = "print('writing to file'); var outputf = new File('test.txt', 'wb'); " \
-						"outputf.writeLine('Hello, World!'); outputf = null; " \
+						"print('file open: ', outputf.isOpen()); outputf.writeLine('Hello, World!'); outputf = null; " \
 						"print('reading from file'); var inputf = new File('test.txt', 'rb'); " \
 						"var inputs = inputf.readLine(); print('input from file: ', inputs)";
 
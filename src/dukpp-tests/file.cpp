@@ -16,6 +16,10 @@ File::~File() {
 	}
 }
 
+bool File::isOpen() const {
+	return _handle != NULL;
+}
+
 void File::writeLine(const char *line) {
 	if (_handle != NULL) {
 		fputs(line, _handle);
@@ -33,15 +37,6 @@ void File::readLine(char *buff, int bufsize) {
 Duktape prototype methods
 */
 
-static duk_ret_t File_writeLine(duk_context *ctx) {
-	File *f = dukbinder_get_from_this<File>(ctx);
-	const char *s = duk_require_string(ctx, 0);
-
-	f->writeLine(s);
-
-	return 0;
-}
-
 static duk_ret_t File_readLine(duk_context *ctx) {
 	File *f = dukbinder_get_from_this<File>(ctx);
 	char buffer[512];
@@ -53,7 +48,8 @@ static duk_ret_t File_readLine(duk_context *ctx) {
 }
 
 const duk_function_list_entry file_prototype[] = {
-	{ "writeLine", File_writeLine, 1 },
+	{ "isOpen", dukpp_bind<&File::isOpen>, dukpp_bind_nargs<&File::isOpen> },
+	{ "writeLine", dukpp_bind<&File::writeLine>, dukpp_bind_nargs<&File::writeLine> },
 	{ "readLine", File_readLine, 0 },
 	{ NULL, NULL, 0 }
 };
@@ -16,6 +16,7 @@ public:
 	File(const char *filename, const char *mode);
 	~File();
 
+	bool isOpen() const;
 	void writeLine(const char *line);
 	void readLine(char *buff, int bufsize);
 };
@@ -6,7 +6,9 @@ const char script[] = "print('my_bool: ', my_bool, toString.call(my_bool)); prin
 						"print('my_int: ', my_int, toString.call(my_int)); " \
 						"print('my_float: ', my_float, toString.call(my_float)); print('my_char: ', my_char, toString.call(my_char)); " \
 						"var script_number = 14.3, script_string = 'such amaze'; script_bool = true; " \
-						"var script_object = {'str': 'wow', 'num': 123.4};";
+						"var script_object = {'str': 'wow', 'num': 123.4}; " \
+						"var script_doubles = new Float64Array([1.5, 2.5, 3.5]), script_ints = [1, 2, 3, 4]; " \
+						"var script_raw = new ArrayBuffer(12);";
 
 void test_push(duk_context *ctx) {
 	dukpp_push<bool>(ctx, true);
@@ -58,6 +60,87 @@ void test_object(duk_context *ctx) {
 	duk_pop(ctx);
 }
 
+static duk_ret_t require_doubles(duk_context *ctx) {
+	dukpp_require< std::vector<double> >(ctx, -1);
+	return 0;
+}
+
+void test_arrays(duk_context *ctx) {
+	std::vector<bool> bools(3, true);
+	std::vector<double> doubles;
+	std::vector<int> ints;
+	dukpp_span<double> view;
+
+	duk_get_global_string(ctx, "script_doubles");
+	doubles = dukpp_require< std::vector<double> >(ctx, -1);
+	printf("script_doubles (as vector): %d elements, last %f\n", (int) doubles.size(), doubles.back());
+
+	view = dukpp_require< dukpp_span<double> >(ctx, -1);
+	view[0] = 10.0;
+	printf("script_doubles (as span): %d elements, first set to %f\n", (int) view.size, view[0]);
+	duk_pop(ctx);
+
+	duk_get_global_string(ctx, "script_ints");
+	ints = dukpp_require< std::vector<int> >(ctx, -1);
+	printf("script_ints (as vector): %d elements, last %d\n", (int) ints.size(), ints.back());
+	duk_pop(ctx);
+
+	dukpp_push(ctx, ints);
+	printf("vector<int> pushed as: %s\n", duk_safe_to_string(ctx, -1));
+	duk_pop(ctx);
+
+	bools[1] = false;
+	dukpp_push(ctx, bools);
+	printf("vector<bool> pushed as: %s\n", duk_safe_to_string(ctx, -1));
+	duk_pop(ctx);
+
+	/* 12 bytes are no array of doubles */
+	duk_get_global_string(ctx, "script_raw");
+	if (duk_safe_call(ctx, require_doubles, 1, 1) != 0) {
+		printf("script_raw (as vector<double>): %s\n", duk_safe_to_string(ctx, -1));
+	}
+	duk_pop(ctx);
+}
+
+static duk_ret_t push_failed_strbuf(duk_context *ctx) {
+	dukpp_strbuf<8> buf;
+	buf.append("kept");
+	buf.append("never read", (size_t) -1);
+	dukpp_push(ctx, buf);
+	return 1;
+}
+
+void test_strings(duk_context *ctx) {
+	std::string with_nul("one\0two", 7);
+	std::string_view view;
+	dukpp_strbuf<8> buf;
+
+	/* NUL characters survive the round trip */
+	dukpp_push(ctx, with_nul);
+	printf("string with NUL: %d characters in Duktape, %d after the round trip, equal %d\n",
+		(int) duk_get_length(ctx, -1), (int) dukpp_require<std::string>(ctx, -1).size(), dukpp_require<std::string>(ctx, -1) == with_nul);
+	view = dukpp_require<std::string_view>(ctx, -1);
+	printf("string with NUL (as string_view): %d characters, second part %s\n", (int) view.size(), view.data() + 4);
+	duk_pop(ctx);
+
+	duk_get_global_string(ctx, "script_string");
+	view = dukpp_get<std::string_view>(ctx, -1);
+	printf("script_string (as string_view): %.*s\n", (int) view.size(), view.data());
+	duk_pop(ctx);
+
+	/* overflow the inline buffer of 8 bytes */
+	buf.append("strbuf: ").append(view.data(), view.size()).append(' ');
+	buf.appendf("%d + %.1f = %s", 40, 2.0, "forty-two");
+	dukpp_push(ctx, buf);
+	printf("%s (%d characters, failed %d)\n", duk_safe_to_string(ctx, -1), (int) buf.size(), buf.failed());
+	duk_pop(ctx);
+
+	if (duk_safe_call(ctx, push_failed_strbuf, 0, 1) != 0) {
+		printf("failed strbuf: %s\n", duk_safe_to_string(ctx, -1));
+	}
+	duk_pop(ctx);
+}
+
 int main(int argc, char const *argv[]) {
 	duk_context *ctx = duk_create_heap_default();
 	
@@ -74,6 +157,8 @@ int main(int argc, char const *argv[]) {
 
 	test_get(ctx);
 	test_object(ctx);
+	test_arrays(ctx);
+	test_strings(ctx);
 
 	duk_destroy_heap(ctx);
 	return 0;
@@ -1,10 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 #include "duk.hpp"
 
 void register_tests(duk_context *ctx);
+void release_tests(duk_context *ctx);
 
-const char script[] = "var o = {}; test(12); test('hello'); test(o); fill(o); print(JSON.stringify(o)); fill(34);";
+const char script[] = "var o = {}; test(12); test('hello'); test(o); fill(o); print(JSON.stringify(o)); " \
+						"listen(function (n) { print('listener 1: ', n); return n * 2; }); listen(function (n) { print('listener 2: ', n); return n + 1; }); " \
+						"notify(21); fill(34);";
 
 int main(int argc, char const *argv[]) {
 	duk_context *ctx = duk_create_heap_default();
@@ -20,6 +24,7 @@ int main(int argc, char const *argv[]) {
 		printf("ERROR: %s\n", duk_safe_to_string(ctx, -1));
 	}
 
+	release_tests(ctx);
 	duk_destroy_heap(ctx);
 	return 0;
 }
@@ -73,8 +78,40 @@ static duk_ret_t fill_object(duk_context *ctx)
 	return 0;
 }
 
+static std::vector<DukRef> listeners;
+
+static duk_ret_t add_listener(duk_context *ctx)
+{
+	duk_require_function(ctx, 0);
+	listeners.push_back(DukRef(ctx, 0));
+	return 0;
+}
+
+static duk_ret_t notify_listeners(duk_context *ctx)
+{
+	int value = duk_require_int(ctx, 0);
+
+	for (size_t i = 0; i < listeners.size(); i++)
+	{
+		printf("listener %d returned %d\n", (int) i + 1, listeners[i].call<int>(value));
+	}
+
+	return 0;
+}
+
+void release_tests(duk_context *ctx)
+{
+	listeners.clear();
+}
+
 void register_tests(duk_context *ctx)
 {
+	duk_push_c_function(ctx, add_listener, 1);
+	duk_put_global_string(ctx, "listen");
+
+	duk_push_c_function(ctx, notify_listeners, 1);
+	duk_put_global_string(ctx, "notify");
+
 	duk_push_c_function(ctx, test_object, 1);
 	duk_put_global_string(ctx, "test");
 
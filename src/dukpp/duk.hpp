@@ -1,7 +1,9 @@
 /*
 C++ wrapper for Duktape.
 
-Define DUKPP_NO_STL to disable the creation of templates for std::string.
+Define DUKPP_NO_STL to disable the creation of templates for std::string,
+std::string_view, std::vector and std::array.
+Requires C++11 (dukpp_bind<&function> requires C++17).
 */
 
 #ifndef _DUKPP_HPP_
@@ -9,14 +11,36 @@ Define DUKPP_NO_STL to disable the creation of templates for std::string.
 
 #include "duktape.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include <type_traits>
+
+/* MSVC only reports the language version in __cplusplus with /Zc:__cplusplus */
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define DUKPP_HAS_CXX17 1
+#else
+#define DUKPP_HAS_CXX17 0
+#endif
+
 #ifndef DUKPP_NO_STL
 #include <string>
+#if DUKPP_HAS_CXX17
+#include <string_view>
+#endif
+#include <vector>
+#include <array>
+#include <iterator>
 #endif
 
 #include "dukutils.hpp"
 #include "dukbinder.hpp"
+#include "dukbind.hpp"
 
 #include "dukvalue.hpp"
+#include "dukref.hpp"
 
 
 #endif // _DUKPP_HPP_
\ No newline at end of file
@@ -0,0 +1,146 @@
+/*
+Compile-time function binding for Duktape.
+
+Generates a duk_c_function for a C++ function or member function from its
+signature. Arguments are read with dukpp_require<T> and the result is pushed
+with dukpp_push<T>, so every type with a dukpp_Impl specialization can be
+used; references are passed as values (const std::string& -> std::string).
+Member functions are called on the dukbinder instance in 'this'.
+
+Usage (C++17):
+
+dukpp_bind<&File::writeLine>        // duk_c_function
+dukpp_bind_nargs<&File::writeLine>  // number of arguments for the function list
+
+Usage (C++11):
+
+DUKPP_BIND(&File::writeLine)
+DUKPP_BIND_NARGS(&File::writeLine)
+
+NOTE:
+Duktape errors are thrown with longjmp by default, so arguments of types with
+destructors (std::string) that were already read leak when a later argument
+is rejected.
+*/
+
+#ifndef _DUKPP_HPP_
+#error __FILE__ ## " is not intended for standalone use."
+#endif
+
+/*
+-----------------------------------------------------------------
+Compile-time list of argument indices.
+*/
+template<duk_idx_t... I>
+struct dukbind_indices {};
+
+template<duk_idx_t N, duk_idx_t... I>
+struct dukbind_make_indices : dukbind_make_indices<N - 1, N - 1, I...> {};
+
+template<duk_idx_t... I>
+struct dukbind_make_indices<0, I...> {
+	typedef dukbind_indices<I...> type;
+};
+
+/*
+-----------------------------------------------------------------
+Call a function with arguments from the stack and push the result.
+*/
+template<typename R>
+struct dukbind_caller {
+	template<typename F, typename... A, duk_idx_t... I>
+	static duk_ret_t call(duk_context *ctx, F func, dukbind_indices<I...>) {
+		dukpp_push<R>(ctx, func(dukpp_require<typename std::decay<A>::type>(ctx, I)...));
+		return 1;
+	}
+
+	template<class T, typename M, typename... A, duk_idx_t... I>
+	static duk_ret_t call_member(duk_context *ctx, T* obj, M method, dukbind_indices<I...>) {
+		dukpp_push<R>(ctx, (obj->*method)(dukpp_require<typename std::decay<A>::type>(ctx, I)...));
+		return 1;
+	}
+};
+
+template<>
+struct dukbind_caller<void> {
+	template<typename F, typename... A, duk_idx_t... I>
+	static duk_ret_t call(duk_context *ctx, F func, dukbind_indices<I...>) {
+		func(dukpp_require<typename std::decay<A>::type>(ctx, I)...);
+		return 0;
+	}
+
+	template<class T, typename M, typename... A, duk_idx_t... I>
+	static duk_ret_t call_member(duk_context *ctx, T* obj, M method, dukbind_indices<I...>) {
+		(obj->*method)(dukpp_require<typename std::decay<A>::type>(ctx, I)...);
+		return 0;
+	}
+};
+
+/* all bound classes share the handle key, so 'this' is checked by its prototype */
+template<class T>
+T* dukbind_require_this(duk_context *ctx) {
+	T* obj = NULL;
+
+	duk_push_this(ctx);
+	if (duk_is_object(ctx, -1) && dukbinder_is<T>(ctx, -1)) {
+		obj = dukbinder_get<T>(ctx, -1);
+	}
+	duk_pop(ctx);
+
+	if (obj == NULL) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "Expected %s as 'this'", dukbinder_Impl<T>::className);
+	}
+	return obj;
+}
+
+/*
+-----------------------------------------------------------------
+Trampolines for free functions and (const) member functions.
+*/
+template<typename F, F func>
+struct dukpp_binder;
+
+template<typename R, typename... A, R (*func)(A...)>
+struct dukpp_binder<R (*)(A...), func> {
+	static const duk_idx_t nargs = sizeof...(A);
+
+	static duk_ret_t call(duk_context *ctx) {
+		return dukbind_caller<typename std::decay<R>::type>::template call<R (*)(A...), A...>(
+			ctx, func, typename dukbind_make_indices<sizeof...(A)>::type());
+	}
+};
+
+template<class T, typename R, typename... A, R (T::*method)(A...)>
+struct dukpp_binder<R (T::*)(A...), method> {
+	static const duk_idx_t nargs = sizeof...(A);
+
+	static duk_ret_t call(duk_context *ctx) {
+		return dukbind_caller<typename std::decay<R>::type>::template call_member<T, R (T::*)(A...), A...>(
+			ctx, dukbind_require_this<T>(ctx), method, typename dukbind_make_indices<sizeof...(A)>::type());
+	}
+};
+
+template<class T, typename R, typename... A, R (T::*method)(A...) const>
+struct dukpp_binder<R (T::*)(A...) const, method> {
+	static const duk_idx_t nargs = sizeof...(A);
+
+	static duk_ret_t call(duk_context *ctx) {
+		return dukbind_caller<typename std::decay<R>::type>::template call_member<const T, R (T::*)(A...) const, A...>(
+			ctx, dukbind_require_this<T>(ctx), method, typename dukbind_make_indices<sizeof...(A)>::type());
+	}
+};
+
+#define DUKPP_BIND(f) (&dukpp_binder<decltype(f), f>::call)
+#define DUKPP_BIND_NARGS(f) (dukpp_binder<decltype(f), f>::nargs)
+
+#if DUKPP_HAS_CXX17
+
+template<auto F>
+duk_ret_t dukpp_bind(duk_context *ctx) {
+	return dukpp_binder<decltype(F), F>::call(ctx);
+}
+
+template<auto F>
+constexpr duk_idx_t dukpp_bind_nargs = dukpp_binder<decltype(F), F>::nargs;
+
+#endif
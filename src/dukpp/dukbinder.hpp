@@ -3,6 +3,11 @@ Duktape templated class binding.
 
 Based on LuaWrapper
 https://bitbucket.org/alexames/luawrapper/src
+
+The prototype and the key of the native pointer are pinned in the heap stash
+and cached as heap pointers, so creating instances, checking their type and
+getting the native pointer need no global or string lookups. As with the
+class and prototype names, a class is bound to one heap at a time.
 */
 
 #ifndef _DUKPP_HPP_
@@ -13,7 +18,8 @@ https://bitbucket.org/alexames/luawrapper/src
 -----------------------------------------------------------------
 Constants used to bind classes to Duktape.
 */
-#define DUKBINDER_HANDLE "$$data"
+/* internal property (not visible to scripts) holding the native pointer */
+#define DUKBINDER_HANDLE "\xff" "dukbinder_data"
 
 /*
 -----------------------------------------------------------------
@@ -40,11 +46,18 @@ struct dukbinder_Impl {
 	static const char *prototypeName;
 	static T* (*allocator)(duk_context *ctx);
 	static void (*deallocator)(duk_context *ctx, T* obj);
+	static void *prototype;
+	static void *handleKey;
 
 	static T* get_instance(duk_context *ctx, duk_idx_t index) {
 		T* result;
 
-		duk_get_prop_string(ctx, index, DUKBINDER_HANDLE);
+		if (index < 0) {
+			index = duk_require_normalize_index(ctx, index);
+		}
+
+		duk_push_heapptr(ctx, handleKey);
+		duk_get_prop(ctx, index);
 		result = static_cast<T*>(duk_get_pointer(ctx, -1));
 		duk_pop(ctx);
 
@@ -65,9 +78,8 @@ struct dukbinder_Impl {
 		duk_bool_t result;
 
 		duk_get_prototype(ctx, index);
-		duk_get_global_string(ctx, prototypeName);
-		result = duk_equals(ctx, -1, -2);
-		duk_pop_2(ctx);
+		result = (duk_get_heapptr(ctx, -1) == prototype);
+		duk_pop(ctx);
 
 		return result;
 	}
@@ -79,12 +91,13 @@ struct dukbinder_Impl {
 		}
 
 		/* set the prototype */
-		duk_get_global_string(ctx, prototypeName);
+		duk_push_heapptr(ctx, prototype);
 		duk_set_prototype(ctx, -2);
 
 		/* set the handle to the pointer */
+		duk_push_heapptr(ctx, handleKey);
 		duk_push_pointer(ctx, obj);
-		duk_put_prop_string(ctx, -2, DUKBINDER_HANDLE);
+		duk_put_prop(ctx, -3);
 	}
 
 	static duk_ret_t constructor(duk_context *ctx) {
@@ -117,6 +130,8 @@ template<class T> const char * dukbinder_Impl<T>::className;
 template<class T> const char * dukbinder_Impl<T>::prototypeName;
 template<class T> T* (*dukbinder_Impl<T>::allocator)(duk_context *ctx);
 template<class T> void (*dukbinder_Impl<T>::deallocator)(duk_context *ctx, T* obj);
+template<class T> void * dukbinder_Impl<T>::prototype;
+template<class T> void * dukbinder_Impl<T>::handleKey;
 
 /*
 -----------------------------------------------------------------
@@ -165,11 +180,25 @@ void dukbinder_register(duk_context *ctx, const char *className, const char *pro
 	dukbinder_Impl<T>::allocator = allocator;
 	dukbinder_Impl<T>::deallocator = deallocator;
 
+	duk_push_heap_stash(ctx);
+
+	/* pin the handle key so its heap pointer stays valid */
+	duk_push_string(ctx, DUKBINDER_HANDLE);
+	dukbinder_Impl<T>::handleKey = duk_get_heapptr(ctx, -1);
+	duk_push_true(ctx);
+	duk_put_prop(ctx, -3);
+
 	duk_push_object(ctx);
 	duk_push_c_function(ctx, dukbinder_Impl<T>::finalizer, 1);
 	duk_set_finalizer(ctx, -2);
 	duk_put_function_list(ctx, -1, prototype);
+	dukbinder_Impl<T>::prototype = duk_get_heapptr(ctx, -1);
+
+	/* the stash keeps the prototype alive, the global is for scripts */
+	duk_dup_top(ctx);
 	duk_put_global_string(ctx, prototypeName);
+	duk_put_prop_string(ctx, -2, prototypeName);
+	duk_pop(ctx);
 
 	duk_push_c_function(ctx, dukbinder_Impl<T>::constructor, DUK_VARARGS);
 	duk_put_global_string(ctx, className);
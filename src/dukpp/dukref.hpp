@@ -0,0 +1,323 @@
+#ifndef _DUKPP_HPP_
+#error __FILE__ ## " is not intended for standalone use."
+#endif
+
+/*
+Persistent reference to a Duktape value.
+
+The value is kept alive in a slot of a table in the heap stash; released
+slots are reused through a free list (slot 0 holds the first free slot), so
+creating and releasing references is O(1). Pushing the value is a single
+duk_push_heapptr for objects, strings and buffers.
+
+References have to be released (destroyed) before the heap is destroyed, and
+the context they were created with must stay valid as long as they do.
+
+Empty references (released, moved from or created with a context) push
+undefined, so calling them fails like calling undefined. Default constructed
+references have no context: use push(ctx) with them, the other helpers
+assert.
+*/
+
+/* internal property of the heap stash holding the reference table */
+#define DUKREF_TABLE "\xff" "dukref"
+
+class DukRef
+{
+private:
+	duk_context *_ctx;
+	void *_table;
+	duk_uarridx_t _slot;
+	void *_ptr;
+
+	/* get the reference table of the heap (created on first use) */
+	static void* table(duk_context *ctx)
+	{
+		void *result;
+
+		duk_push_heap_stash(ctx);
+		if (!duk_get_prop_string(ctx, -1, DUKREF_TABLE))
+		{
+			duk_pop(ctx);
+			duk_push_array(ctx);
+			duk_push_uint(ctx, 0);
+			duk_put_prop_index(ctx, -2, 0);
+			duk_dup_top(ctx);
+			duk_put_prop_string(ctx, -3, DUKREF_TABLE);
+		}
+		result = duk_get_heapptr(ctx, -1);
+		duk_pop_2(ctx);
+
+		return result;
+	}
+
+	void pin(duk_context *ctx, duk_idx_t index)
+	{
+		duk_uarridx_t free_slot;
+
+		index = duk_require_normalize_index(ctx, index);
+
+		_ctx = ctx;
+		_table = table(ctx);
+		_ptr = duk_get_heapptr(ctx, index);
+
+		duk_push_heapptr(ctx, _table);
+
+		/* take the first free slot or append one */
+		duk_get_prop_index(ctx, -1, 0);
+		free_slot = (duk_uarridx_t) duk_get_uint(ctx, -1);
+		duk_pop(ctx);
+
+		if (free_slot != 0)
+		{
+			_slot = free_slot;
+			duk_get_prop_index(ctx, -1, _slot);
+			duk_put_prop_index(ctx, -2, 0);
+		}
+		else
+		{
+			_slot = (duk_uarridx_t) duk_get_length(ctx, -1);
+		}
+
+		duk_dup(ctx, index);
+		duk_put_prop_index(ctx, -2, _slot);
+		duk_pop(ctx);
+	}
+
+	void take(DukRef& other)
+	{
+		_ctx = other._ctx;
+		_table = other._table;
+		_slot = other._slot;
+		_ptr = other._ptr;
+
+		/* the moved-from reference is empty but keeps the context */
+		other._table = NULL;
+		other._slot = 0;
+		other._ptr = NULL;
+	}
+
+public:
+
+	/* empty reference without a context */
+	DukRef() : _ctx(NULL), _table(NULL), _slot(0), _ptr(NULL)
+	{
+	}
+
+	/* empty reference of ctx */
+	explicit DukRef(duk_context *ctx) : _ctx(ctx), _table(NULL), _slot(0), _ptr(NULL)
+	{
+	}
+
+	/* reference the value at index */
+	DukRef(duk_context *ctx, duk_idx_t index) : _ctx(NULL), _table(NULL), _slot(0), _ptr(NULL)
+	{
+		pin(ctx, index);
+	}
+
+	/* copies take a slot of their own */
+	DukRef(const DukRef& other) : _ctx(other._ctx), _table(NULL), _slot(0), _ptr(NULL)
+	{
+		if (other._slot != 0)
+		{
+			other.push();
+			pin(other._ctx, -1);
+			duk_pop(_ctx);
+		}
+	}
+
+	DukRef(DukRef&& other) noexcept : _ctx(NULL)
+	{
+		take(other);
+	}
+
+	~DukRef()
+	{
+		release();
+	}
+
+	DukRef& operator=(const DukRef& other)
+	{
+		if (this != &other)
+		{
+			DukRef copy(other);
+			release();
+			take(copy);
+		}
+		return *this;
+	}
+
+	DukRef& operator=(DukRef&& other) noexcept
+	{
+		if (this != &other)
+		{
+			release();
+			take(other);
+		}
+		return *this;
+	}
+
+	/* release the value and put the slot on the free list (the context is kept) */
+	void release()
+	{
+		if (_slot == 0)
+		{
+			return;
+		}
+
+		duk_push_heapptr(_ctx, _table);
+		duk_get_prop_index(_ctx, -1, 0);
+		duk_put_prop_index(_ctx, -2, _slot);
+		duk_push_uint(_ctx, _slot);
+		duk_put_prop_index(_ctx, -2, 0);
+		duk_pop(_ctx);
+
+		_table = NULL;
+		_slot = 0;
+		_ptr = NULL;
+	}
+
+	/* reference the value at index instead */
+	void reset(duk_context *ctx, duk_idx_t index)
+	{
+		DukRef ref(ctx, index);
+		release();
+		take(ref);
+	}
+
+	bool empty() const
+	{
+		return _slot == 0;
+	}
+
+	operator bool() const
+	{
+		return _slot != 0;
+	}
+
+	duk_context* context() const
+	{
+		return _ctx;
+	}
+
+	/* push the value to ctx (a context of the same heap), undefined for empty references */
+	void push(duk_context *ctx) const
+	{
+		if (_ptr != NULL)
+		{
+			duk_push_heapptr(ctx, _ptr);
+		}
+		else if (_slot != 0)
+		{
+			duk_push_heapptr(ctx, _table);
+			duk_get_prop_index(ctx, -1, _slot);
+			duk_remove(ctx, -2);
+		}
+		else
+		{
+			duk_push_undefined(ctx);
+		}
+	}
+
+	/* push the value to the context of the reference */
+	void push() const
+	{
+		assert(_ctx != NULL && "DukRef without a context, use push(ctx)");
+		push(_ctx);
+	}
+
+	/* push the value and wrap it */
+	DukValue value() const
+	{
+		push();
+		return DukValue(_ctx, -1);
+	}
+
+	/* call the referenced function; the result or error is left on the stack */
+	template<typename... A>
+	duk_int_t pcall(const A&... args) const
+	{
+		push();
+		dukref_push_args(_ctx, args...);
+		return duk_pcall(_ctx, sizeof...(A));
+	}
+
+	/* call the referenced function as a method of the value at this_index */
+	template<typename... A>
+	duk_int_t pcall_method(duk_idx_t this_index, const A&... args) const
+	{
+		this_index = duk_require_normalize_index(_ctx, this_index);
+		push();
+		duk_dup(_ctx, this_index);
+		dukref_push_args(_ctx, args...);
+		return duk_pcall_method(_ctx, sizeof...(A));
+	}
+
+	/* call the referenced function and return its result (errors are thrown) */
+	template<typename R = void, typename... A>
+	R call(const A&... args) const
+	{
+		push();
+		dukref_push_args(_ctx, args...);
+		duk_call(_ctx, sizeof...(A));
+		return dukref_result<R>::pop(_ctx);
+	}
+
+private:
+
+	static void dukref_push_args(duk_context *ctx)
+	{
+	}
+
+	template<typename A>
+	static void dukref_push_arg(duk_context *ctx, const A& arg)
+	{
+		dukpp_push<A>(ctx, arg);
+	}
+
+	/* string literals */
+	static void dukref_push_arg(duk_context *ctx, const char *arg)
+	{
+		duk_push_string(ctx, arg);
+	}
+
+	template<typename A, typename... R>
+	static void dukref_push_args(duk_context *ctx, const A& arg, const R&... rest)
+	{
+		dukref_push_arg(ctx, arg);
+		dukref_push_args(ctx, rest...);
+	}
+
+	template<typename R>
+	struct dukref_result
+	{
+		static R pop(duk_context *ctx)
+		{
+			R result = dukpp_get<R>(ctx, -1);
+			duk_pop(ctx);
+			return result;
+		}
+	};
+
+};
+
+template<>
+struct DukRef::dukref_result<void>
+{
+	static void pop(duk_context *ctx)
+	{
+		duk_pop(ctx);
+	}
+};
+
+/*
+References as arguments and results of dukpp functions (and dukpp_bind).
+*/
+template<>
+struct dukpp_Impl<DukRef> {
+	static bool dukpp_is(duk_context *ctx, duk_idx_t index) { return static_cast<bool>(duk_is_undefined(ctx, index) == 0); }
+	static DukRef dukpp_require(duk_context *ctx, duk_idx_t index) { duk_require_valid_index(ctx, index); return DukRef(ctx, index); }
+	static DukRef dukpp_get(duk_context *ctx, duk_idx_t index) { return duk_is_valid_index(ctx, index) ? DukRef(ctx, index) : DukRef(ctx); }
+	static void dukpp_to(duk_context *ctx, duk_idx_t index) { }
+	static void dukpp_push(duk_context *ctx, const DukRef& value) { value.push(ctx); }
+};
@@ -21,7 +21,26 @@ dukpp_setfield(context, index, field, value)
 Predefined specializations:
 
 bool, const char*, int, long, char, unsigned int, unsigned long, unsigned char,
-float, double and std::string
+float, double, std::string, std::string_view (C++17) and dukpp_strbuf<N>
+
+Strings:
+
+std::string and std::string_view use the length of the Duktape string, so they
+can hold NUL characters. std::string_view borrows the interned string and is
+only valid while the value is on the stack. dukpp_strbuf<N> builds strings in
+an inline buffer of N bytes (growing on the heap only when it overflows) and
+is pushed without rescanning; if it runs out of memory, failed() is set and
+pushing it throws an error instead of a truncated string.
+
+Arrays:
+
+dukpp_span<T>, std::vector<T> and std::array<T, N> map to typed arrays for
+arithmetic T (Float64Array for double, Int32Array for int, ...) with a single
+memcpy; plain buffers and ArrayBuffers are read as raw elements (TypeError if
+their size or alignment does not fit T). Other values (JS arrays, typed arrays
+of another element type, T without a typed array) are converted element by
+element. dukpp_span<T> borrows the buffer data of the
+value instead of copying it and is only valid while the value is on the stack.
 
 */
 
@@ -244,6 +263,346 @@ struct dukpp_Impl<double> {
 	static void dukpp_push(duk_context *ctx, const double& value) { duk_push_number(ctx, value); }
 };
 
+/*
+-----------------------------------------------------------------
+Bulk conversion of arrays to and from typed arrays.
+*/
+
+/* typed array flags and constructor name of arithmetic types (flags 0 if none) */
+template<size_t Size, bool Signed, bool Float>
+struct dukpp_typedarray_sized { static const duk_uint_t flags = 0; static const char *name() { return NULL; } };
+
+template<> struct dukpp_typedarray_sized<1, true, false> { static const duk_uint_t flags = DUK_BUFOBJ_INT8ARRAY; static const char *name() { return "Int8Array"; } };
+template<> struct dukpp_typedarray_sized<1, false, false> { static const duk_uint_t flags = DUK_BUFOBJ_UINT8ARRAY; static const char *name() { return "Uint8Array"; } };
+template<> struct dukpp_typedarray_sized<2, true, false> { static const duk_uint_t flags = DUK_BUFOBJ_INT16ARRAY; static const char *name() { return "Int16Array"; } };
+template<> struct dukpp_typedarray_sized<2, false, false> { static const duk_uint_t flags = DUK_BUFOBJ_UINT16ARRAY; static const char *name() { return "Uint16Array"; } };
+template<> struct dukpp_typedarray_sized<4, true, false> { static const duk_uint_t flags = DUK_BUFOBJ_INT32ARRAY; static const char *name() { return "Int32Array"; } };
+template<> struct dukpp_typedarray_sized<4, false, false> { static const duk_uint_t flags = DUK_BUFOBJ_UINT32ARRAY; static const char *name() { return "Uint32Array"; } };
+template<> struct dukpp_typedarray_sized<4, true, true> { static const duk_uint_t flags = DUK_BUFOBJ_FLOAT32ARRAY; static const char *name() { return "Float32Array"; } };
+template<> struct dukpp_typedarray_sized<8, true, true> { static const duk_uint_t flags = DUK_BUFOBJ_FLOAT64ARRAY; static const char *name() { return "Float64Array"; } };
+
+template<typename T>
+struct dukpp_typedarray : std::conditional<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+	dukpp_typedarray_sized<sizeof(T), std::is_signed<T>::value, std::is_floating_point<T>::value>,
+	dukpp_typedarray_sized<0, false, false> >::type {};
+
+/* ArrayBuffer and DataView (Duktape gives them BYTES_PER_ELEMENT 1 like a Uint8Array) */
+inline bool dukpp_instanceof_global(duk_context *ctx, duk_idx_t index, const char *name) {
+	bool result;
+
+	duk_get_global_string(ctx, name);
+	result = duk_is_object(ctx, -1) && duk_instanceof(ctx, index, -1);
+	duk_pop(ctx);
+
+	return result;
+}
+
+inline bool dukpp_is_raw_buffer_object(duk_context *ctx, duk_idx_t index) {
+	return !duk_has_prop_string(ctx, index, "BYTES_PER_ELEMENT") ||
+		dukpp_instanceof_global(ctx, index, "ArrayBuffer") || dukpp_instanceof_global(ctx, index, "DataView");
+}
+
+/*
+Get the elements of a buffer, buffer object or typed array of element type T
+without copying, or NULL if the value has to be converted element by element.
+Plain buffers and ArrayBuffers are raw elements: a TypeError is thrown (or NULL
+returned if raw_errors is false) if their size is not a multiple of sizeof(T)
+or their data is not aligned for T.
+*/
+template<typename T>
+T* dukpp_get_array_data(duk_context *ctx, duk_idx_t index, duk_size_t *count, bool raw_errors = true) {
+	duk_size_t size;
+	void *data;
+
+	if (dukpp_typedarray<T>::flags == 0 || !(duk_is_buffer(ctx, index) || duk_is_object(ctx, index))) {
+		return NULL;
+	}
+
+	index = duk_require_normalize_index(ctx, index);
+	data = duk_get_buffer_data(ctx, index, &size);
+	if (data == NULL) {
+		return NULL;
+	}
+
+	/* typed arrays must have the same element type, other buffers are raw memory */
+	if (duk_is_object(ctx, index) && !dukpp_is_raw_buffer_object(ctx, index)) {
+		if (!dukpp_instanceof_global(ctx, index, dukpp_typedarray<T>::name())) {
+			return NULL;
+		}
+	}
+
+	if (size % sizeof(T) != 0 || reinterpret_cast<size_t>(data) % sizeof(T) != 0) {
+		if (!raw_errors) {
+			return NULL;
+		}
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "buffer of %lu bytes does not match %s (size or alignment, stack index %d)",
+			(unsigned long) size, dukpp_typedarray<T>::name(), index);
+		return NULL;
+	}
+
+	*count = size / sizeof(T);
+	return static_cast<T*>(data);
+}
+
+/* push count elements as a typed array (or a JS array if T has no typed array) */
+template<typename T>
+void dukpp_push_array(duk_context *ctx, const T *data, duk_size_t count) {
+	if (dukpp_typedarray<T>::flags != 0) {
+		void *buffer = duk_push_fixed_buffer(ctx, count * sizeof(T));
+		if (count > 0) {
+			memcpy(buffer, data, count * sizeof(T));
+		}
+		duk_push_buffer_object(ctx, -1, 0, count * sizeof(T), dukpp_typedarray<T>::flags);
+		duk_remove(ctx, -2);
+	} else {
+		duk_idx_t arr = duk_push_array(ctx);
+		for (duk_size_t i = 0; i < count; i++) {
+			dukpp_push<T>(ctx, data[i]);
+			duk_put_prop_index(ctx, arr, (duk_uarridx_t) i);
+		}
+	}
+}
+
+inline bool dukpp_is_array(duk_context *ctx, duk_idx_t index) {
+	return duk_is_array(ctx, index) || duk_is_buffer(ctx, index) ||
+		(duk_is_object(ctx, index) && !duk_is_function(ctx, index) && duk_has_prop_string(ctx, index, "length"));
+}
+
+/*
+Copy the elements of an array-like value to out (an output iterator), at most
+max elements; returns the number of elements of the value.
+*/
+template<typename T, typename Out>
+duk_size_t dukpp_copy_array(duk_context *ctx, duk_idx_t index, Out out, duk_size_t max) {
+	duk_size_t count;
+	const T *data = dukpp_get_array_data<T>(ctx, index, &count);
+
+	if (data != NULL) {
+		for (duk_size_t i = 0; i < count && i < max; i++) {
+			*out++ = data[i];
+		}
+		return count;
+	}
+
+	count = duk_get_length(ctx, index);
+	if (index < 0) {
+		index = duk_require_normalize_index(ctx, index);
+	}
+	for (duk_size_t i = 0; i < count && i < max; i++) {
+		duk_get_prop_index(ctx, index, (duk_uarridx_t) i);
+		*out++ = dukpp_require<T>(ctx, -1);
+		duk_pop(ctx);
+	}
+	return count;
+}
+
+/*
+Borrowed view of the elements of a typed array or buffer.
+*/
+template<typename T>
+struct dukpp_span {
+	T *data;
+	duk_size_t size;
+
+	dukpp_span() : data(NULL), size(0) {}
+	dukpp_span(T *data, duk_size_t size) : data(data), size(size) {}
+
+	T* begin() const { return data; }
+	T* end() const { return data + size; }
+	T& operator[](duk_size_t i) const { return data[i]; }
+};
+
+template<typename T>
+struct dukpp_Impl< dukpp_span<T> > {
+	typedef typename std::remove_const<T>::type E;
+
+	static bool dukpp_is(duk_context *ctx, duk_idx_t index) {
+		duk_size_t count;
+		return dukpp_get_array_data<E>(ctx, index, &count, false) != NULL;
+	}
+	static dukpp_span<T> dukpp_require(duk_context *ctx, duk_idx_t index) {
+		duk_size_t count = 0;
+		E *data = dukpp_get_array_data<E>(ctx, index, &count);
+		/* empty dynamic buffers have no data */
+		if (data == NULL && !(duk_is_buffer(ctx, index) && duk_get_length(ctx, index) == 0)) {
+			duk_error(ctx, DUK_ERR_TYPE_ERROR, "%s or buffer required (stack index %d)", dukpp_typedarray<E>::name(), index);
+		}
+		return dukpp_span<T>(data, count);
+	}
+	static dukpp_span<T> dukpp_get(duk_context *ctx, duk_idx_t index) {
+		duk_size_t count = 0;
+		E *data = dukpp_get_array_data<E>(ctx, index, &count, false);
+		return (data != NULL) ? dukpp_span<T>(data, count) : dukpp_span<T>();
+	}
+	static void dukpp_to(duk_context *ctx, duk_idx_t index) { }
+	static void dukpp_push(duk_context *ctx, const dukpp_span<T>& value) { dukpp_push_array<E>(ctx, value.data, value.size); }
+};
+
+/*
+-----------------------------------------------------------------
+String builder for results built in C++.
+*/
+template<size_t N = 256>
+class dukpp_strbuf {
+private:
+	char _inline[N];
+	char *_data;
+	size_t _size;
+	size_t _capacity;
+	bool _failed;
+
+	bool reserve(size_t capacity) {
+		char *data;
+
+		if (capacity <= _capacity) {
+			return true;
+		}
+		if (capacity < _capacity * 2) {
+			capacity = _capacity * 2;
+		}
+
+		data = static_cast<char*>((_data == _inline) ? malloc(capacity) : realloc(_data, capacity));
+		if (data == NULL) {
+			_failed = true;
+			return false;
+		}
+		if (_data == _inline) {
+			memcpy(data, _inline, _size);
+		}
+
+		_data = data;
+		_capacity = capacity;
+		return true;
+	}
+
+	void take(dukpp_strbuf& other) {
+		if (other._data == other._inline) {
+			memcpy(_inline, other._inline, other._size);
+			_data = _inline;
+			_capacity = N;
+		} else {
+			_data = other._data;
+			_capacity = other._capacity;
+			other._data = other._inline;
+			other._capacity = N;
+		}
+		_size = other._size;
+		_failed = other._failed;
+		other._size = 0;
+		other._failed = false;
+	}
+
+public:
+	dukpp_strbuf() : _data(_inline), _size(0), _capacity(N), _failed(false) {}
+
+	dukpp_strbuf(const dukpp_strbuf& other) : _data(_inline), _size(0), _capacity(N), _failed(other._failed) { append(other.data(), other.size()); }
+
+	dukpp_strbuf(dukpp_strbuf&& other) { take(other); }
+
+	~dukpp_strbuf() {
+		if (_data != _inline) {
+			free(_data);
+		}
+	}
+
+	dukpp_strbuf& operator=(const dukpp_strbuf& other) {
+		if (this != &other) {
+			clear();
+			_failed = other._failed;
+			append(other.data(), other.size());
+		}
+		return *this;
+	}
+
+	dukpp_strbuf& operator=(dukpp_strbuf&& other) {
+		if (this != &other) {
+			if (_data != _inline) {
+				free(_data);
+			}
+			take(other);
+		}
+		return *this;
+	}
+
+	const char* data() const { return _data; }
+	size_t size() const { return _size; }
+	void clear() { _size = 0; _failed = false; }
+
+	/* true if an append ran out of memory (or hit a format error); the contents are incomplete */
+	bool failed() const { return _failed; }
+
+	dukpp_strbuf& append(const char *str, size_t len) {
+		if (len > ((size_t) -1) - _size) {
+			_failed = true;
+		} else if (reserve(_size + len)) {
+			memcpy(_data + _size, str, len);
+			_size += len;
+		}
+		return *this;
+	}
+
+	dukpp_strbuf& append(const char *str) { return append(str, strlen(str)); }
+
+	dukpp_strbuf& append(char c) { return append(&c, 1); }
+
+	/* append formatted text (printf format) */
+	dukpp_strbuf& appendf(const char *fmt, ...) {
+		va_list args;
+		int len;
+
+		va_start(args, fmt);
+		len = vsnprintf(_data + _size, _capacity - _size, fmt, args);
+		va_end(args);
+
+		if (len < 0) {
+			_failed = true;
+			return *this;
+		}
+
+		if (len > 0 && (size_t) len >= _capacity - _size) {
+			/* vsnprintf needs room for the terminating NUL */
+			if (!reserve(_size + (size_t) len + 1)) {
+				return *this;
+			}
+			va_start(args, fmt);
+			vsnprintf(_data + _size, _capacity - _size, fmt, args);
+			va_end(args);
+		}
+		if (len > 0) {
+			_size += (size_t) len;
+		}
+		return *this;
+	}
+};
+
+template<size_t N>
+struct dukpp_Impl< dukpp_strbuf<N> > {
+	static bool dukpp_is(duk_context *ctx, duk_idx_t index) { return static_cast<bool>(duk_is_string(ctx, index) != 0); }
+	static dukpp_strbuf<N> dukpp_require(duk_context *ctx, duk_idx_t index) {
+		duk_size_t len;
+		const char *str = duk_require_lstring(ctx, index, &len);
+		dukpp_strbuf<N> result;
+		result.append(str, len);
+		return result;
+	}
+	static dukpp_strbuf<N> dukpp_get(duk_context *ctx, duk_idx_t index) {
+		duk_size_t len;
+		const char *str = duk_get_lstring(ctx, index, &len);
+		dukpp_strbuf<N> result;
+		if (str != NULL) {
+			result.append(str, len);
+		}
+		return result;
+	}
+	static void dukpp_to(duk_context *ctx, duk_idx_t index) { (duk_to_string(ctx, index)); }
+	static void dukpp_push(duk_context *ctx, const dukpp_strbuf<N>& value) {
+		if (value.failed()) {
+			duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not build string (%lu bytes kept)", (unsigned long) value.size());
+		}
+		duk_push_lstring(ctx, value.data(), value.size());
+	}
+};
+
 /*
 template<>
 struct dukpp_Impl<void*> {
@@ -261,10 +620,110 @@ struct dukpp_Impl<void*> {
 template<>
 struct dukpp_Impl<std::string> {
 	static bool dukpp_is(duk_context *ctx, duk_idx_t index) { return static_cast<bool>(duk_is_string(ctx, index) != 0); }
-	static std::string dukpp_require(duk_context *ctx, duk_idx_t index) { return std::string(duk_require_string(ctx, index)); }
-	static std::string dukpp_get(duk_context *ctx, duk_idx_t index) { return std::string(duk_get_string(ctx, index)); }
+	static std::string dukpp_require(duk_context *ctx, duk_idx_t index) {
+		duk_size_t len;
+		const char *str = duk_require_lstring(ctx, index, &len);
+		return std::string(str, len);
+	}
+	static std::string dukpp_get(duk_context *ctx, duk_idx_t index) {
+		duk_size_t len;
+		const char *str = duk_get_lstring(ctx, index, &len);
+		return (str != NULL) ? std::string(str, len) : std::string();
+	}
 	static void dukpp_to(duk_context *ctx, duk_idx_t index) { (duk_to_string(ctx, index)); }
-	static void dukpp_push(duk_context *ctx, const std::string& value) { duk_push_string(ctx, value.c_str()); }
+	static void dukpp_push(duk_context *ctx, const std::string& value) { duk_push_lstring(ctx, value.data(), value.size()); }
+};
+
+#if DUKPP_HAS_CXX17
+
+template<>
+struct dukpp_Impl<std::string_view> {
+	static bool dukpp_is(duk_context *ctx, duk_idx_t index) { return static_cast<bool>(duk_is_string(ctx, index) != 0); }
+	static std::string_view dukpp_require(duk_context *ctx, duk_idx_t index) {
+		duk_size_t len;
+		const char *str = duk_require_lstring(ctx, index, &len);
+		return std::string_view(str, len);
+	}
+	static std::string_view dukpp_get(duk_context *ctx, duk_idx_t index) {
+		duk_size_t len;
+		const char *str = duk_get_lstring(ctx, index, &len);
+		return (str != NULL) ? std::string_view(str, len) : std::string_view();
+	}
+	static void dukpp_to(duk_context *ctx, duk_idx_t index) { (duk_to_string(ctx, index)); }
+	static void dukpp_push(duk_context *ctx, const std::string_view& value) { duk_push_lstring(ctx, value.data(), value.size()); }
+};
+
+#endif
+
+template<typename T>
+void dukpp_push_vector(duk_context *ctx, const std::vector<T>& value) {
+	dukpp_push_array<T>(ctx, value.data(), value.size());
+}
+
+/* std::vector<bool> has no contiguous elements */
+inline void dukpp_push_vector(duk_context *ctx, const std::vector<bool>& value) {
+	duk_idx_t arr = duk_push_array(ctx);
+	for (duk_size_t i = 0; i < value.size(); i++) {
+		duk_push_boolean(ctx, value[i]);
+		duk_put_prop_index(ctx, arr, (duk_uarridx_t) i);
+	}
+}
+
+template<typename T>
+struct dukpp_Impl< std::vector<T> > {
+	static bool dukpp_is(duk_context *ctx, duk_idx_t index) { return dukpp_is_array(ctx, index); }
+	static std::vector<T> dukpp_require(duk_context *ctx, duk_idx_t index) {
+		if (!dukpp_is_array(ctx, index)) {
+			duk_error(ctx, DUK_ERR_TYPE_ERROR, "array or buffer required (stack index %d)", index);
+		}
+		return dukpp_get(ctx, index);
+	}
+	static std::vector<T> dukpp_get(duk_context *ctx, duk_idx_t index) {
+		std::vector<T> result;
+		duk_size_t count;
+		const T *data;
+
+		if (!dukpp_is_array(ctx, index)) {
+			return result;
+		}
+
+		data = dukpp_get_array_data<T>(ctx, index, &count);
+		if (data != NULL) {
+			result.assign(data, data + count);
+		} else {
+			result.reserve(duk_get_length(ctx, index));
+			dukpp_copy_array<T>(ctx, index, std::back_inserter(result), (duk_size_t) -1);
+		}
+		return result;
+	}
+	static void dukpp_to(duk_context *ctx, duk_idx_t index) { }
+	static void dukpp_push(duk_context *ctx, const std::vector<T>& value) { dukpp_push_vector(ctx, value); }
+};
+
+template<typename T, size_t N>
+struct dukpp_Impl< std::array<T, N> > {
+	static bool dukpp_is(duk_context *ctx, duk_idx_t index) { return dukpp_is_array(ctx, index); }
+	static std::array<T, N> dukpp_require(duk_context *ctx, duk_idx_t index) {
+		std::array<T, N> result = std::array<T, N>();
+		duk_size_t count = 0;
+
+		if (dukpp_is_array(ctx, index)) {
+			count = dukpp_copy_array<T>(ctx, index, result.begin(), N);
+		}
+		if (count != N) {
+			duk_error(ctx, DUK_ERR_TYPE_ERROR, "array of %d elements required (stack index %d)", (int) N, index);
+		}
+		return result;
+	}
+	static std::array<T, N> dukpp_get(duk_context *ctx, duk_idx_t index) {
+		std::array<T, N> result = std::array<T, N>();
+		if (dukpp_is_array(ctx, index)) {
+			dukpp_copy_array<T>(ctx, index, result.begin(), N);
+		}
+		return result;
+	}
+	static void dukpp_to(duk_context *ctx, duk_idx_t index) { }
+	static void dukpp_push(duk_context *ctx, const std::array<T, N>& value) { dukpp_push_array<T>(ctx, value.data(), N); }
 };
 
 #endif
\ No newline at end of file
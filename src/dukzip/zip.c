@@ -6,21 +6,165 @@ Uses zlib and minizip.
 define BUILD_AS_DLL to build as a duktape module.
 */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <duktape.h>
 
+#include <zlib.h>
 #include <zip.h>
 #include <unzip.h>
 
-#ifdef DEBUG
-#include <stdio.h>
+/* threads for the batch operations (same primitives as the duk-node event loop) */
+
+#if defined(_WIN32)
+
+	#include <windows.h>
+
+	typedef HANDLE dukzip_thread;
+	typedef CRITICAL_SECTION dukzip_mutex;
+	typedef CONDITION_VARIABLE dukzip_cond;
+
+	#define dukzip_mutex_init(m) InitializeCriticalSection(m)
+	#define dukzip_mutex_destroy(m) DeleteCriticalSection(m)
+	#define dukzip_mutex_lock(m) EnterCriticalSection(m)
+	#define dukzip_mutex_unlock(m) LeaveCriticalSection(m)
+	#define dukzip_cond_init(c) InitializeConditionVariable(c)
+	#define dukzip_cond_destroy(c) (void)(c)
+	#define dukzip_cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+	#define dukzip_cond_broadcast(c) WakeAllConditionVariable(c)
+
+	#define DUKZIP_THREAD_FUNC(name) static DWORD WINAPI name(LPVOID arg)
+	#define DUKZIP_THREAD_RETURN return 0
+
+	#include <direct.h>
+	#define dukzip_mkdir(path) _mkdir(path)
+
+#else
+
+	#include <pthread.h>
+	#include <unistd.h>
+
+	typedef pthread_t dukzip_thread;
+	typedef pthread_mutex_t dukzip_mutex;
+	typedef pthread_cond_t dukzip_cond;
+
+	#define dukzip_mutex_init(m) pthread_mutex_init(m, NULL)
+	#define dukzip_mutex_destroy(m) pthread_mutex_destroy(m)
+	#define dukzip_mutex_lock(m) pthread_mutex_lock(m)
+	#define dukzip_mutex_unlock(m) pthread_mutex_unlock(m)
+	#define dukzip_cond_init(c) pthread_cond_init(c, NULL)
+	#define dukzip_cond_destroy(c) pthread_cond_destroy(c)
+	#define dukzip_cond_wait(c, m) pthread_cond_wait(c, m)
+	#define dukzip_cond_broadcast(c) pthread_cond_broadcast(c)
+
+	#define DUKZIP_THREAD_FUNC(name) static void *name(void *arg)
+	#define DUKZIP_THREAD_RETURN return NULL
+
+	#include <sys/stat.h>
+	#include <sys/types.h>
+	#define dukzip_mkdir(path) mkdir(path, 0777)
+
 #endif
 
+/* maximum number of worker threads of the batch operations */
+#define DUKZIP_MAX_THREADS 64
+
 /* ---------------------------------------------------------- */
 
 #define ZIPHANDLE_PROP "$$zfile"
 #define ZIPFILENAME_PROP "path"
 #define DUKZIP_UNZ_PROTOTYPE "DukzipArchiveReadablePrototype"
 #define DUKZIP_ZIP_PROTOTYPE "DukzipArchiveWritablePrototype"
+#define DUKZIP_ENTRY_PROTOTYPE "DukzipEntryReadablePrototype"
+
+/* archive properties of in-memory archives: the memory stream and the buffer it reads from */
+#define ZIPMEM_PROP "$$mem"
+#define ZIPMEM_SOURCE_PROP "$$source"
+
+/* archive property holding the central directory index */
+#define ZIPINDEX_PROP "$$index"
+
+/* archive property counting opened entries, entry properties pointing back to it */
+#define ZIPENTRYID_PROP "$$entryid"
+#define ZIPENTRY_ARCHIVE_PROP "archive"
+#define ZIPENTRY_ID_PROP "$$id"
+
+/* default chunk size of entry reads */
+#define DUKZIP_CHUNK_SIZE (64 * 1024)
+
+/* ---------------------------------------------------------- */
+
+static int dukzip_cpu_count(void) {
+#if defined(_WIN32)
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (int) si.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? (int) n : 1;
+#else
+	return 1;
+#endif
+}
+
+/* get the threads option of the object at idx (the number of CPUs by default) */
+static int dukzip_get_threads(duk_context *ctx, duk_idx_t idx) {
+	int n = 0;
+
+	if (duk_is_object(ctx, idx)) {
+		duk_get_prop_string(ctx, idx, "threads");
+		if (duk_is_number(ctx, -1)) {
+			n = duk_get_int(ctx, -1);
+		}
+		duk_pop(ctx);
+	}
+
+	if (n <= 0) {
+		n = dukzip_cpu_count();
+	}
+	return (n > DUKZIP_MAX_THREADS) ? DUKZIP_MAX_THREADS : n;
+}
+
+/* start n threads running func(arg), returns the number started */
+static int dukzip_start_threads(dukzip_thread *threads, int n,
+#if defined(_WIN32)
+	LPTHREAD_START_ROUTINE func,
+#else
+	void *(*func)(void *),
+#endif
+	void *arg)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+#if defined(_WIN32)
+		threads[i] = CreateThread(NULL, 0, func, arg, 0, NULL);
+		if (threads[i] == NULL) {
+			break;
+		}
+#else
+		if (pthread_create(&threads[i], NULL, func, arg) != 0) {
+			break;
+		}
+#endif
+	}
+	return i;
+}
+
+static void dukzip_join_threads(dukzip_thread *threads, int n) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+#if defined(_WIN32)
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+#else
+		pthread_join(threads[i], NULL);
+#endif
+	}
+}
 
 /* ---------------------------------------------------------- */
 
@@ -46,6 +190,326 @@ static unzFile dukzip_unz_from_this(duk_context *ctx) {
 	return f;
 }
 
+/*
+In-memory archives
+
+A memory stream is plugged into minizip as a zlib_filefunc64_def; the
+"filename" minizip passes to the open callback is the dukzip_mem itself, and
+every open gets its own cursor so that several handles (see extractAll) can
+read the same memory. Readers use the data of a Duktape buffer in place,
+writers grow a malloc'd block that finish() copies into a buffer.
+*/
+
+typedef struct {
+	unsigned char *data;
+	ZPOS64_T size;
+	ZPOS64_T cap;
+	int growable;          /* 1 for writers (data is owned) */
+} dukzip_mem;
+
+typedef struct {
+	dukzip_mem *mem;
+	ZPOS64_T pos;
+	int error;
+} dukzip_mem_cursor;
+
+static voidpf ZCALLBACK dukzip_mem_open(voidpf opaque, const void *filename, int mode) {
+	dukzip_mem_cursor *cur = calloc(1, sizeof(dukzip_mem_cursor));
+	if (cur != NULL) {
+		cur->mem = (dukzip_mem *) filename;
+		if ((mode & ZLIB_FILEFUNC_MODE_CREATE) && cur->mem->growable) {
+			cur->mem->size = 0;
+		}
+	}
+	return cur;
+}
+
+static uLong ZCALLBACK dukzip_mem_read(voidpf opaque, voidpf stream, void *buf, uLong size) {
+	dukzip_mem_cursor *cur = stream;
+	ZPOS64_T left = (cur->pos < cur->mem->size) ? cur->mem->size - cur->pos : 0;
+
+	if (size > left) {
+		size = (uLong) left;
+	}
+	memcpy(buf, cur->mem->data + cur->pos, size);
+	cur->pos += size;
+	return size;
+}
+
+static uLong ZCALLBACK dukzip_mem_write(voidpf opaque, voidpf stream, const void *buf, uLong size) {
+	dukzip_mem_cursor *cur = stream;
+	dukzip_mem *mem = cur->mem;
+	ZPOS64_T end = cur->pos + size;
+
+	if (!mem->growable) {
+		cur->error = 1;
+		return 0;
+	}
+
+	if (end > mem->cap) {
+		ZPOS64_T cap = mem->cap ? mem->cap : 64 * 1024;
+		unsigned char *data;
+
+		while (cap < end) {
+			cap *= 2;
+		}
+		if (cap != (ZPOS64_T) (size_t) cap || (data = realloc(mem->data, (size_t) cap)) == NULL) {
+			cur->error = 1;
+			return 0;
+		}
+		mem->data = data;
+		mem->cap = cap;
+	}
+
+	/* seeking past the end leaves a gap */
+	if (cur->pos > mem->size) {
+		memset(mem->data + mem->size, 0, (size_t) (cur->pos - mem->size));
+	}
+
+	memcpy(mem->data + cur->pos, buf, size);
+	cur->pos = end;
+	if (end > mem->size) {
+		mem->size = end;
+	}
+	return size;
+}
+
+static ZPOS64_T ZCALLBACK dukzip_mem_tell(voidpf opaque, voidpf stream) {
+	return ((dukzip_mem_cursor *) stream)->pos;
+}
+
+static long ZCALLBACK dukzip_mem_seek(voidpf opaque, voidpf stream, ZPOS64_T offset, int origin) {
+	dukzip_mem_cursor *cur = stream;
+	ZPOS64_T base;
+
+	switch (origin) {
+	case ZLIB_FILEFUNC_SEEK_CUR: base = cur->pos; break;
+	case ZLIB_FILEFUNC_SEEK_END: base = cur->mem->size; break;
+	case ZLIB_FILEFUNC_SEEK_SET: base = 0; break;
+	default: return -1;
+	}
+
+	if (base + offset > cur->mem->size && !cur->mem->growable) {
+		return -1;
+	}
+	cur->pos = base + offset;
+	return 0;
+}
+
+static int ZCALLBACK dukzip_mem_close(voidpf opaque, voidpf stream) {
+	free(stream);
+	return 0;
+}
+
+static int ZCALLBACK dukzip_mem_error(voidpf opaque, voidpf stream) {
+	return ((dukzip_mem_cursor *) stream)->error;
+}
+
+static void dukzip_mem_filefunc(zlib_filefunc64_def *ff) {
+	ff->zopen64_file = dukzip_mem_open;
+	ff->zread_file = dukzip_mem_read;
+	ff->zwrite_file = dukzip_mem_write;
+	ff->ztell64_file = dukzip_mem_tell;
+	ff->zseek64_file = dukzip_mem_seek;
+	ff->zclose_file = dukzip_mem_close;
+	ff->zerror_file = dukzip_mem_error;
+	ff->opaque = NULL;
+}
+
+/* open the archive at path, or the memory stream mem if it is not NULL */
+static unzFile dukzip_unz_open(const char *path, dukzip_mem *mem) {
+	if (mem != NULL) {
+		zlib_filefunc64_def ff;
+		dukzip_mem_filefunc(&ff);
+		return unzOpen2_64(mem, &ff);
+	}
+	return unzOpen64(path);
+}
+
+/* ---------------------------------------------------------- */
+
+/*
+Central directory index
+
+Built once when an archive is opened for reading: a hash table from entry
+names to their central directory positions, sizes and CRCs, so that getFile,
+stat and openEntry jump to an entry with unzGoToFilePos64 instead of scanning
+the directory with unzLocateFile. Names are compared case-sensitively; on
+Windows (where minizip compares case-insensitively by default) a miss falls
+back to unzLocateFile.
+*/
+
+typedef struct {
+	unz64_file_pos pos;
+	ZPOS64_T compressed;
+	ZPOS64_T uncompressed;
+	uLong crc;
+	size_t name;           /* offset in the names block */
+	unsigned int namelen;
+	unsigned int hash;
+} dukzip_index_entry;
+
+typedef struct {
+	dukzip_index_entry *entries;
+	size_t count;
+	char *names;
+	unsigned int *slots;   /* entry index + 1, 0 for empty slots */
+	size_t mask;
+} dukzip_index;
+
+/* FNV-1a */
+static unsigned int dukzip_hash(const char *name, size_t len) {
+	unsigned int h = 2166136261U;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char) name[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void dukzip_index_free(dukzip_index *index) {
+	if (index) {
+		free(index->entries);
+		free(index->names);
+		free(index->slots);
+		free(index);
+	}
+}
+
+/* walk the central directory once, returns NULL when out of memory or on errors */
+static dukzip_index *dukzip_index_build(unzFile archive) {
+	unz_global_info64 global;
+	dukzip_index *index;
+	size_t cap, names_size = 0, names_cap = 4096, i, nslots;
+	int res;
+
+	if (unzGetGlobalInfo64(archive, &global) != UNZ_OK) {
+		return NULL;
+	}
+
+	index = calloc(1, sizeof(dukzip_index));
+	if (index == NULL) {
+		return NULL;
+	}
+
+	/* number_entry is only 16 bits in archives without zip64 records, so keep growing */
+	cap = (global.number_entry > 0) ? (size_t) global.number_entry : 16;
+	index->entries = malloc(cap * sizeof(dukzip_index_entry));
+	index->names = malloc(names_cap);
+	if (index->entries == NULL || index->names == NULL) {
+		goto fail;
+	}
+
+	for (res = unzGoToFirstFile(archive); res == UNZ_OK; res = unzGoToNextFile(archive)) {
+		unz_file_info64 info;
+		dukzip_index_entry *e;
+
+		if (index->count == cap) {
+			dukzip_index_entry *entries = realloc(index->entries, cap * 2 * sizeof(dukzip_index_entry));
+			if (entries == NULL) {
+				goto fail;
+			}
+			index->entries = entries;
+			cap *= 2;
+		}
+
+		if (unzGetCurrentFileInfo64(archive, &info, NULL, 0, NULL, 0, NULL, 0) != UNZ_OK) {
+			goto fail;
+		}
+		while (names_size + info.size_filename > names_cap) {
+			char *names = realloc(index->names, names_cap * 2);
+			if (names == NULL) {
+				goto fail;
+			}
+			index->names = names;
+			names_cap *= 2;
+		}
+
+		e = &index->entries[index->count];
+		unzGetCurrentFileInfo64(archive, &info, index->names + names_size, info.size_filename, NULL, 0, NULL, 0);
+		unzGetFilePos64(archive, &e->pos);
+		e->compressed = info.compressed_size;
+		e->uncompressed = info.uncompressed_size;
+		e->crc = info.crc;
+		e->name = names_size;
+		e->namelen = (unsigned int) info.size_filename;
+		e->hash = dukzip_hash(index->names + names_size, e->namelen);
+
+		names_size += info.size_filename;
+		index->count++;
+	}
+	if (res != UNZ_END_OF_LIST_OF_FILE) {
+		goto fail;
+	}
+	unzGoToFirstFile(archive);
+
+	/* power of two with a load factor of at most one half */
+	for (nslots = 16; nslots < index->count * 2; nslots *= 2) {}
+	index->slots = calloc(nslots, sizeof(unsigned int));
+	if (index->slots == NULL) {
+		goto fail;
+	}
+	index->mask = nslots - 1;
+
+	for (i = 0; i < index->count; i++) {
+		size_t slot = index->entries[i].hash & index->mask;
+		while (index->slots[slot] != 0) {
+			slot = (slot + 1) & index->mask;
+		}
+		index->slots[slot] = (unsigned int) (i + 1);
+	}
+
+	return index;
+
+fail:
+	unzGoToFirstFile(archive);
+	dukzip_index_free(index);
+	return NULL;
+}
+
+/* find an entry by name, NULL if it is not in the archive */
+static dukzip_index_entry *dukzip_index_find(dukzip_index *index, const char *name, size_t len) {
+	unsigned int h = dukzip_hash(name, len);
+	size_t slot = h & index->mask;
+
+	while (index->slots[slot] != 0) {
+		dukzip_index_entry *e = &index->entries[index->slots[slot] - 1];
+		if (e->hash == h && e->namelen == len && memcmp(index->names + e->name, name, len) == 0) {
+			return e;
+		}
+		slot = (slot + 1) & index->mask;
+	}
+	return NULL;
+}
+
+static dukzip_index *dukzip_unz_index_from_this(duk_context *ctx) {
+	dukzip_index *index;
+
+	duk_push_this(ctx);
+	duk_get_prop_string(ctx, -1, ZIPINDEX_PROP);
+	index = duk_get_pointer(ctx, -1);
+	duk_pop_2(ctx);
+	return index;
+}
+
+/* make the named file the current file, returns UNZ_OK or UNZ_END_OF_LIST_OF_FILE */
+static int dukzip_unz_locate(duk_context *ctx, unzFile archive, const char *filename, duk_size_t len) {
+	dukzip_index *index = dukzip_unz_index_from_this(ctx);
+
+	if (index != NULL) {
+		dukzip_index_entry *e = dukzip_index_find(index, filename, len);
+		if (e != NULL) {
+			return unzGoToFilePos64(archive, &e->pos);
+		}
+#if !defined(_WIN32)
+		return UNZ_END_OF_LIST_OF_FILE;
+#endif
+	}
+
+	return unzLocateFile(archive, filename, 0);
+}
+
 static void dukzip_push_unzfile(duk_context *ctx, unzFile archive, const char *filename) {
 	/* create object with readable Dukzip archive prototype */
 	duk_push_object(ctx);
@@ -59,12 +523,23 @@ static void dukzip_push_unzfile(duk_context *ctx, unzFile archive, const char *f
 	/* set path property */
 	duk_push_string(ctx, filename);
 	duk_put_prop_string(ctx, -2, ZIPFILENAME_PROP);
+
+	/* without an index (out of memory) lookups scan the directory */
+	duk_push_pointer(ctx, dukzip_index_build(archive));
+	duk_put_prop_string(ctx, -2, ZIPINDEX_PROP);
 }
 
 static duk_ret_t dukzip_unz_finalizer(duk_context *ctx) {
 	unzFile archive = dukzip_require_unz(ctx, 0);
 	unzClose(archive);
 
+	duk_get_prop_string(ctx, 0, ZIPINDEX_PROP);
+	dukzip_index_free(duk_get_pointer(ctx, -1));
+
+	/* the data of in-memory readers belongs to the source buffer */
+	duk_get_prop_string(ctx, 0, ZIPMEM_PROP);
+	free(duk_get_pointer(ctx, -1));
+
 	return 0;
 }
 
@@ -72,12 +547,20 @@ static duk_ret_t dukzip_unz_finalizer(duk_context *ctx) {
 
 static duk_ret_t dukzip_unz_listfiles(duk_context *ctx) {
 	unzFile archive = dukzip_unz_from_this(ctx);
-
-	unzGoToFirstFile(archive);
+	dukzip_index *index = dukzip_unz_index_from_this(ctx);
 	int i = 0, res;
 	duk_idx_t arr_idx = duk_push_array(ctx);
 
-	do {
+	if (index != NULL) {
+		size_t n;
+		for (n = 0; n < index->count; n++) {
+			duk_push_lstring(ctx, index->names + index->entries[n].name, index->entries[n].namelen);
+			duk_put_prop_index(ctx, arr_idx, (duk_uarridx_t) n);
+		}
+		return 1;
+	}
+
+	for (res = unzGoToFirstFile(archive); res == UNZ_OK; res = unzGoToNextFile(archive)) {
 		// unz_file_info fileInfo;
 		// unzGetCurrentFileInfo(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
 		unz_file_info64 fileInfo;
@@ -98,10 +581,7 @@ static duk_ret_t dukzip_unz_listfiles(duk_context *ctx) {
 #if !defined(__GNUC__) || defined(DUK_NO_VLA)
 		free(fileName);
 #endif
-
-		res = unzGoToNextFile(archive);
-
-	} while (res != UNZ_END_OF_LIST_OF_FILE || res == UNZ_OK);
+	}
 
 	return 1;
 }
@@ -122,128 +602,715 @@ static duk_ret_t dukzip_unz_getnextfile(duk_context *ctx) {
 	unzFile archive = dukzip_unz_from_this(ctx);
 	int res = unzGoToNextFile(archive);
 
-	if (res == UNZ_OK) {
-		duk_push_true(ctx);
-	} else {
-		duk_push_false(ctx);
+	if (res == UNZ_OK) {
+		duk_push_true(ctx);
+	} else {
+		duk_push_false(ctx);
+	}
+	return 1;
+}
+
+static duk_ret_t dukzip_unz_getfile(duk_context *ctx) {
+	unzFile archive = dukzip_unz_from_this(ctx);
+	duk_size_t len;
+	const char *filename = duk_require_lstring(ctx, 0, &len);
+	int res = dukzip_unz_locate(ctx, archive, filename, len);
+
+	if (res == UNZ_OK) {
+		duk_push_true(ctx);
+	} else {
+		duk_push_false(ctx);
+	}
+	return 1;
+}
+
+/* stat(filename) : { filename, compressed, uncompressed, crc } of the named file (null if missing), leaves the current file alone */
+static duk_ret_t dukzip_unz_stat(duk_context *ctx) {
+	unzFile archive = dukzip_unz_from_this(ctx);
+	dukzip_index *index = dukzip_unz_index_from_this(ctx);
+	duk_size_t len;
+	const char *filename = duk_require_lstring(ctx, 0, &len);
+	ZPOS64_T compressed, uncompressed;
+	uLong crc;
+
+	dukzip_index_entry *e = (index != NULL) ? dukzip_index_find(index, filename, len) : NULL;
+	if (e != NULL) {
+		compressed = e->compressed;
+		uncompressed = e->uncompressed;
+		crc = e->crc;
+	} else {
+		/* no index (or a case-insensitive match on Windows): locate and restore the current file */
+		unz64_file_pos pos;
+		unz_file_info64 fileInfo;
+
+		if (index != NULL) {
+#if !defined(_WIN32)
+			duk_push_null(ctx);
+			return 1;
+#endif
+		}
+
+		unzGetFilePos64(archive, &pos);
+		if (unzLocateFile(archive, filename, 0) != UNZ_OK) {
+			unzGoToFilePos64(archive, &pos);
+			duk_push_null(ctx);
+			return 1;
+		}
+		unzGetCurrentFileInfo64(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
+		unzGoToFilePos64(archive, &pos);
+
+		compressed = fileInfo.compressed_size;
+		uncompressed = fileInfo.uncompressed_size;
+		crc = fileInfo.crc;
+	}
+
+	duk_push_object(ctx);
+	duk_dup(ctx, 0);
+	duk_put_prop_string(ctx, -2, "filename");
+	duk_push_number(ctx, (duk_double_t) compressed);
+	duk_put_prop_string(ctx, -2, "compressed");
+	duk_push_number(ctx, (duk_double_t) uncompressed);
+	duk_put_prop_string(ctx, -2, "uncompressed");
+	duk_push_number(ctx, (duk_double_t) crc);
+	duk_put_prop_string(ctx, -2, "crc");
+	return 1;
+}
+
+static duk_ret_t dukzip_unz_getfilename(duk_context *ctx) {
+	// unz_file_info fileInfo;
+	unz_file_info64 fileInfo;
+	unzFile archive = dukzip_unz_from_this(ctx);
+
+	// unzGetCurrentFileInfo(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
+	unzGetCurrentFileInfo64(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
+
+#if defined(__GNUC__) && !defined(DUK_NO_VLA)
+	char fileName[fileInfo.size_filename];
+#else
+	char *fileName = malloc(fileInfo.size_filename);
+#endif
+
+	// unzGetCurrentFileInfo(archive, &fileInfo, fileName, fileInfo.size_filename, NULL, 0, NULL, 0);
+	unzGetCurrentFileInfo64(archive, &fileInfo, fileName, fileInfo.size_filename, NULL, 0, NULL, 0);
+
+	duk_push_lstring(ctx, fileName, fileInfo.size_filename);
+
+#if !defined(__GNUC__) || defined(DUK_NO_VLA)
+	free(fileName);
+#endif
+
+	return 1;
+}
+
+static duk_ret_t dukzip_unz_getfileinfo(duk_context *ctx) {
+	duk_idx_t info_obj;
+	// unz_file_info fileInfo;
+	unz_file_info64 fileInfo;
+	unzFile archive = dukzip_unz_from_this(ctx);
+
+	// unzGetCurrentFileInfo(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
+	unzGetCurrentFileInfo64(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
+
+#if defined(__GNUC__) && !defined(DUK_NO_VLA)
+	char fileName[fileInfo.size_filename],
+		extraField[fileInfo.size_file_extra],
+		commentString[fileInfo.size_file_comment];
+#else
+	char *fileName = malloc(fileInfo.size_filename); 
+	char *extraField = malloc(fileInfo.size_file_extra); 
+	char *commentString = malloc(fileInfo.size_file_comment);
+#endif
+
+	// unzGetCurrentFileInfo(archive, &fileInfo, 
+	// 	fileName, fileInfo.size_filename,
+	// 	extraField, fileInfo.size_file_extra,
+	// 	commentString, fileInfo.size_file_comment);
+	unzGetCurrentFileInfo64(archive, &fileInfo, 
+		fileName, fileInfo.size_filename,
+		extraField, fileInfo.size_file_extra,
+		commentString, fileInfo.size_file_comment);
+
+	info_obj = duk_push_object(ctx);
+
+	/* numbers instead of ints so that entries over 4GB keep their sizes */
+	duk_push_number(ctx, (duk_double_t) fileInfo.compressed_size);
+	duk_put_prop_string(ctx, info_obj, "compressed");
+
+	duk_push_number(ctx, (duk_double_t) fileInfo.uncompressed_size);
+	duk_put_prop_string(ctx, info_obj, "uncompressed");
+
+	duk_push_lstring(ctx, fileName, fileInfo.size_filename);
+	duk_put_prop_string(ctx, info_obj, "filename");
+
+	duk_push_lstring(ctx, extraField, fileInfo.size_file_extra);
+	duk_put_prop_string(ctx, info_obj, "extra");
+
+	duk_push_lstring(ctx, commentString, fileInfo.size_file_comment);
+	duk_put_prop_string(ctx, info_obj, "comment");
+
+#if !defined(__GNUC__) || defined(DUK_NO_VLA)
+	free(fileName);
+	free(extraField);
+	free(commentString);
+#endif
+
+	return 1;
+}
+
+/* mark the archive's current entry as replaced and return the id of the new one */
+static duk_int_t dukzip_unz_next_entry_id(duk_context *ctx, duk_idx_t archive_idx) {
+	duk_int_t id;
+
+	archive_idx = duk_require_normalize_index(ctx, archive_idx);
+	duk_get_prop_string(ctx, archive_idx, ZIPENTRYID_PROP);
+	id = duk_get_int(ctx, -1) + 1;
+	duk_pop(ctx);
+
+	duk_push_int(ctx, id);
+	duk_put_prop_string(ctx, archive_idx, ZIPENTRYID_PROP);
+	return id;
+}
+
+/* read up to len bytes of the current file, returns the number of bytes read */
+static duk_size_t dukzip_unz_read(duk_context *ctx, unzFile archive, char *bytes, duk_size_t len) {
+	duk_size_t total = 0;
+
+	/* unzReadCurrentFile takes an unsigned length, so read large requests in pieces */
+	while (total < len) {
+		unsigned chunk = (len - total > 0x40000000) ? 0x40000000 : (unsigned) (len - total);
+		int ret = unzReadCurrentFile(archive, bytes + total, chunk);
+		if (ret < 0) {
+			duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "unable to read file in archive (error code %d)", ret);
+		}
+		if (ret == 0) {
+			break;
+		}
+		total += ret;
+	}
+
+	return total;
+}
+
+static duk_ret_t dukzip_unz_readfile(duk_context *ctx) {
+	unz_file_info64 fileInfo;
+	unzFile archive = dukzip_unz_from_this(ctx);
+	int ret = UNZ_OK;
+
+	unzGetCurrentFileInfo64(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
+	if (fileInfo.uncompressed_size > (ZPOS64_T) (duk_size_t) -1) {
+		duk_error(ctx, DUK_ERR_RANGE_ERROR, "file in archive is too large to read at once (use openEntry)");
+		return -1;
+	}
+	void *bytes = duk_push_fixed_buffer(ctx, (duk_size_t) fileInfo.uncompressed_size);
+
+	/* this closes an entry opened with openEntry */
+	duk_push_this(ctx);
+	dukzip_unz_next_entry_id(ctx, -1);
+	duk_pop(ctx);
+
+	ret = unzOpenCurrentFile(archive);
+	if (ret != UNZ_OK) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "unable to open file in archive");
+		return -1;
+	}
+
+	dukzip_unz_read(ctx, archive, bytes, (duk_size_t) fileInfo.uncompressed_size);
+	unzCloseCurrentFile(archive);
+
+	return 1;
+}
+
+/*
+Streaming entry reader
+
+openEntry([filename]) opens the current (or the named) file and returns an
+entry object that inflates it in chunks: read([n]), readInto(buffer, [offset],
+[length]), pipe(dest, [options]) and close(). Only one entry of an archive is
+open at a time; opening another one (or calling readFile) closes it.
+*/
+
+/* get the archive of the entry at 'this', checking that the entry is still open */
+static unzFile dukzip_entry_from_this(duk_context *ctx) {
+	unzFile archive;
+	duk_int_t id;
+
+	duk_push_this(ctx);
+	duk_get_prop_string(ctx, -1, ZIPENTRY_ID_PROP);
+	id = duk_get_int(ctx, -1);
+	duk_get_prop_string(ctx, -2, ZIPENTRY_ARCHIVE_PROP);
+	if (!duk_is_object(ctx, -1)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "Expected dukzip entry");
+	}
+	archive = dukzip_require_unz(ctx, -1);
+	duk_get_prop_string(ctx, -1, ZIPENTRYID_PROP);
+	if (id == 0 || duk_get_int(ctx, -1) != id) {
+		duk_error(ctx, DUK_ERR_ERROR, "entry is no longer open");
+	}
+	duk_pop_n(ctx, 4);
+
+	return archive;
+}
+
+static duk_ret_t dukzip_unz_openentry(duk_context *ctx) {
+	unz_file_info64 fileInfo;
+	unzFile archive = dukzip_unz_from_this(ctx);
+	duk_idx_t entry_idx;
+	duk_int_t id;
+	int ret;
+
+	if (duk_is_string(ctx, 0)) {
+		duk_size_t len;
+		const char *filename = duk_get_lstring(ctx, 0, &len);
+		if (dukzip_unz_locate(ctx, archive, filename, len) != UNZ_OK) {
+			duk_error(ctx, DUK_ERR_ERROR, "file '%s' not found in archive", filename);
+			return -1;
+		}
+	}
+
+	ret = unzGetCurrentFileInfo64(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
+	if (ret != UNZ_OK) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "unable to get file info in archive");
+		return -1;
+	}
+
+	ret = unzOpenCurrentFile(archive);
+	if (ret != UNZ_OK) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "unable to open file in archive");
+		return -1;
+	}
+
+	duk_push_this(ctx);
+	id = dukzip_unz_next_entry_id(ctx, -1);
+
+	entry_idx = duk_push_object(ctx);
+	duk_get_global_string(ctx, DUKZIP_ENTRY_PROTOTYPE);
+	duk_set_prototype(ctx, entry_idx);
+
+	duk_dup(ctx, -2);
+	duk_put_prop_string(ctx, entry_idx, ZIPENTRY_ARCHIVE_PROP);
+	duk_push_int(ctx, id);
+	duk_put_prop_string(ctx, entry_idx, ZIPENTRY_ID_PROP);
+
+	dukzip_unz_getfilename(ctx);
+	duk_put_prop_string(ctx, entry_idx, "filename");
+
+	duk_push_number(ctx, (duk_double_t) fileInfo.uncompressed_size);
+	duk_put_prop_string(ctx, entry_idx, "size");
+	duk_push_number(ctx, (duk_double_t) fileInfo.compressed_size);
+	duk_put_prop_string(ctx, entry_idx, "compressedSize");
+
+	return 1;
+}
+
+/* entry.read([n]) : reads up to n bytes (64K by default) into a new buffer, null at the end of the entry */
+static duk_ret_t dukzip_entry_read(duk_context *ctx) {
+	unzFile archive = dukzip_entry_from_this(ctx);
+	duk_size_t len = duk_is_number(ctx, 0) ? (duk_size_t) duk_require_uint(ctx, 0) : DUKZIP_CHUNK_SIZE;
+	duk_size_t got;
+	char *bytes;
+
+	if (len == 0) {
+		len = DUKZIP_CHUNK_SIZE;
+	}
+
+	bytes = duk_push_buffer_raw(ctx, len, DUK_BUF_FLAG_DYNAMIC | DUK_BUF_FLAG_NOZERO);
+	got = dukzip_unz_read(ctx, archive, bytes, len);
+	if (got == 0) {
+		duk_push_null(ctx);
+		return 1;
+	}
+
+	duk_resize_buffer(ctx, -1, got);
+	return 1;
+}
+
+/* entry.readInto(buffer, [offset], [length]) : fills the buffer, returns the number of bytes read (0 at the end) */
+static duk_ret_t dukzip_entry_readinto(duk_context *ctx) {
+	unzFile archive = dukzip_entry_from_this(ctx);
+	duk_size_t sz, offset, length;
+	char *buffer = duk_require_buffer_data(ctx, 0, &sz);
+
+	offset = duk_is_number(ctx, 1) ? (duk_size_t) duk_require_uint(ctx, 1) : 0;
+	if (offset > sz) {
+		duk_error(ctx, DUK_ERR_RANGE_ERROR, "offset out of range");
+		return -1;
+	}
+
+	length = duk_is_number(ctx, 2) ? (duk_size_t) duk_require_uint(ctx, 2) : sz - offset;
+	if (length > sz - offset) {
+		duk_error(ctx, DUK_ERR_RANGE_ERROR, "length out of range");
+		return -1;
+	}
+
+	duk_push_number(ctx, (duk_double_t) dukzip_unz_read(ctx, archive, buffer + offset, length));
+	return 1;
+}
+
+/* entry.close() : stops reading (checks the CRC when the whole entry was read) */
+static duk_ret_t dukzip_entry_close(duk_context *ctx) {
+	unzFile archive = dukzip_entry_from_this(ctx);
+	int ret = unzCloseCurrentFile(archive);
+
+	duk_push_this(ctx);
+	duk_push_int(ctx, 0);
+	duk_put_prop_string(ctx, -2, ZIPENTRY_ID_PROP);
+
+	if (ret == UNZ_CRCERROR) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "CRC error in file in archive");
+		return -1;
+	}
+	return 0;
+}
+
+/* entry.pipe(dest, [options]) : writes the entry to dest in chunks, calls dest.end() unless options.end is false */
+static duk_ret_t dukzip_entry_pipe(duk_context *ctx) {
+	unzFile archive = dukzip_entry_from_this(ctx);
+	int end = 1;
+
+	if (duk_is_object(ctx, 1)) {
+		duk_get_prop_string(ctx, 1, "end");
+		end = !(duk_is_boolean(ctx, -1) && !duk_get_boolean(ctx, -1));
+		duk_pop(ctx);
+	}
+
+	for (;;) {
+		/* a new buffer per chunk, since dest may keep it */
+		char *bytes = duk_push_buffer_raw(ctx, DUKZIP_CHUNK_SIZE, DUK_BUF_FLAG_DYNAMIC | DUK_BUF_FLAG_NOZERO);
+		duk_size_t got = dukzip_unz_read(ctx, archive, bytes, DUKZIP_CHUNK_SIZE);
+		if (got == 0) {
+			duk_pop(ctx);
+			break;
+		}
+		duk_resize_buffer(ctx, -1, got);
+
+		duk_push_string(ctx, "write");
+		duk_insert(ctx, -2);
+		duk_call_prop(ctx, 0, 1);
+		duk_pop(ctx);
+	}
+
+	dukzip_entry_close(ctx);
+	duk_pop(ctx); /* this pushed by close */
+
+	if (end) {
+		duk_get_prop_string(ctx, 0, "end");
+		if (duk_is_function(ctx, -1)) {
+			duk_dup(ctx, 0);
+			duk_call_method(ctx, 0);
+		}
+		duk_pop(ctx);
+	}
+
+	duk_dup(ctx, 0);
+	return 1;
+}
+
+/*
+Parallel extraction
+
+extractAll(dest, [options]) writes every file of the archive below the
+directory dest. Worker threads each open their own handle on the archive
+file, take entries from the central directory index and inflate them
+straight to disk in chunks. options.threads sets the number of workers (the
+number of CPUs by default); options.progress(filename, done, total) is called
+on this thread as entries are finished. Entries with absolute paths or '..'
+components are refused. Returns the number of entries extracted.
+*/
+
+typedef struct {
+	const char *path;      /* archive */
+	dukzip_mem *mem;       /* or in-memory archive */
+	const char *dest;
+	dukzip_index *index;
+
+	size_t next;           /* next entry to take */
+	size_t *finished;      /* entries in the order they were finished */
+	size_t nfinished;
+	int abort;
+	char error[256];
+
+	dukzip_mutex lock;
+	dukzip_cond done_cond;
+} dukzip_extract_batch;
+
+/* check that an entry name stays below the destination directory */
+static int dukzip_safe_name(const char *name, size_t len) {
+	size_t i, start = 0;
+
+	if (len == 0 || name[0] == '/' || name[0] == '\\' || (len > 1 && name[1] == ':')) {
+		return 0;
+	}
+
+	for (i = 0; i <= len; i++) {
+		if (i == len || name[i] == '/' || name[i] == '\\') {
+			if (i - start == 2 && name[start] == '.' && name[start + 1] == '.') {
+				return 0;
+			}
+			start = i + 1;
+		}
+	}
+	return 1;
+}
+
+/* create the parent directories of path (and path itself if it ends with a slash) */
+static int dukzip_make_dirs(char *path) {
+	char *p;
+
+	for (p = path + 1; *p; p++) {
+		if (*p == '/' || *p == '\\') {
+			char c = *p;
+			*p = '\0';
+			if (dukzip_mkdir(path) != 0 && errno != EEXIST) {
+				*p = c;
+				return -1;
+			}
+			*p = c;
+		}
+	}
+	return 0;
+}
+
+/* extract the entry the archive is positioned at to path, returns 0 or -1 with an error message */
+static int dukzip_extract_entry(unzFile archive, char *path, size_t pathlen, char *buf, size_t bufsize, char *error, size_t errsize) {
+	FILE *out;
+	int n, res;
+
+	if (dukzip_make_dirs(path) != 0) {
+		snprintf(error, errsize, "could not create directory for '%s': %s", path, strerror(errno));
+		return -1;
+	}
+
+	/* directory entries */
+	if (path[pathlen - 1] == '/' || path[pathlen - 1] == '\\') {
+		return 0;
+	}
+
+	if (unzOpenCurrentFile(archive) != UNZ_OK) {
+		snprintf(error, errsize, "unable to open file '%s' in archive", path);
+		return -1;
 	}
-	return 1;
-}
 
-static duk_ret_t dukzip_unz_getfile(duk_context *ctx) {
-	unzFile archive = dukzip_unz_from_this(ctx);
-	const char *filename = duk_require_string(ctx, 0);
-	int res = unzLocateFile(archive, filename, 0);
+	out = fopen(path, "wb");
+	if (out == NULL) {
+		snprintf(error, errsize, "could not open file '%s': %s", path, strerror(errno));
+		unzCloseCurrentFile(archive);
+		return -1;
+	}
 
-	if (res == UNZ_OK) {
-		duk_push_true(ctx);
-	} else {
-		duk_push_false(ctx);
+	while ((n = unzReadCurrentFile(archive, buf, (unsigned) bufsize)) > 0) {
+		if (fwrite(buf, 1, n, out) != (size_t) n) {
+			snprintf(error, errsize, "could not write file '%s': %s", path, strerror(errno));
+			n = -1;
+			break;
+		}
+	}
+	if (n < 0 && error[0] == '\0') {
+		snprintf(error, errsize, "unable to read file '%s' in archive (error code %d)", path, n);
 	}
-	return 1;
-}
 
-static duk_ret_t dukzip_unz_getfilename(duk_context *ctx) {
-	// unz_file_info fileInfo;
-	unz_file_info64 fileInfo;
-	unzFile archive = dukzip_unz_from_this(ctx);
+	res = unzCloseCurrentFile(archive);
+	if (n == 0 && res == UNZ_CRCERROR) {
+		snprintf(error, errsize, "CRC error in file '%s'", path);
+		n = -1;
+	}
+	if (fclose(out) != 0 && n == 0) {
+		snprintf(error, errsize, "could not write file '%s': %s", path, strerror(errno));
+		n = -1;
+	}
 
-	// unzGetCurrentFileInfo(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
-	unzGetCurrentFileInfo64(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
+	return (n < 0) ? -1 : 0;
+}
 
-#if defined(__GNUC__) && !defined(DUK_NO_VLA)
-	char fileName[fileInfo.size_filename];
-#else
-	char *fileName = malloc(fileInfo.size_filename);
-#endif
+DUKZIP_THREAD_FUNC(dukzip_extract_worker) {
+	dukzip_extract_batch *batch = arg;
+	size_t destlen = strlen(batch->dest);
+	char error[256];
+	char *buf = malloc(DUKZIP_CHUNK_SIZE);
+	char *path = NULL;
+	size_t pathcap = 0;
+	unzFile archive = dukzip_unz_open(batch->path, batch->mem);
+
+	if (archive == NULL || buf == NULL) {
+		dukzip_mutex_lock(&batch->lock);
+		if (!batch->abort) {
+			snprintf(batch->error, sizeof(batch->error), "could not open file '%s'", batch->path);
+			batch->abort = 1;
+		}
+		dukzip_cond_broadcast(&batch->done_cond);
+		dukzip_mutex_unlock(&batch->lock);
+		goto done;
+	}
 
-	// unzGetCurrentFileInfo(archive, &fileInfo, fileName, fileInfo.size_filename, NULL, 0, NULL, 0);
-	unzGetCurrentFileInfo64(archive, &fileInfo, fileName, fileInfo.size_filename, NULL, 0, NULL, 0);
+	for (;;) {
+		dukzip_index_entry *e;
+		size_t i, len;
+		int res = 0;
 
-	duk_push_lstring(ctx, fileName, fileInfo.size_filename);
+		dukzip_mutex_lock(&batch->lock);
+		if (batch->abort || batch->next == batch->index->count) {
+			dukzip_mutex_unlock(&batch->lock);
+			break;
+		}
+		i = batch->next++;
+		dukzip_mutex_unlock(&batch->lock);
+
+		e = &batch->index->entries[i];
+		len = destlen + 1 + e->namelen;
+		if (len + 1 > pathcap) {
+			char *p = realloc(path, len + 1);
+			if (p == NULL) {
+				snprintf(error, sizeof(error), "out of memory");
+				res = -1;
+			} else {
+				path = p;
+				pathcap = len + 1;
+			}
+		}
 
-#if !defined(__GNUC__) || defined(DUK_NO_VLA)
-	free(fileName);
-#endif
+		if (res == 0) {
+			memcpy(path, batch->dest, destlen);
+			path[destlen] = '/';
+			memcpy(path + destlen + 1, batch->index->names + e->name, e->namelen);
+			path[len] = '\0';
+
+			error[0] = '\0';
+			if (unzGoToFilePos64(archive, &e->pos) != UNZ_OK) {
+				snprintf(error, sizeof(error), "unable to find file '%s' in archive", path);
+				res = -1;
+			} else {
+				res = dukzip_extract_entry(archive, path, len, buf, DUKZIP_CHUNK_SIZE, error, sizeof(error));
+			}
+		}
 
-	return 1;
-}
+		dukzip_mutex_lock(&batch->lock);
+		if (res == 0) {
+			batch->finished[batch->nfinished++] = i;
+		} else if (!batch->abort) {
+			memcpy(batch->error, error, sizeof(error));
+			batch->abort = 1;
+		}
+		dukzip_cond_broadcast(&batch->done_cond);
+		dukzip_mutex_unlock(&batch->lock);
+	}
 
-static duk_ret_t dukzip_unz_getfileinfo(duk_context *ctx) {
-	duk_idx_t info_obj;
-	// unz_file_info fileInfo;
-	unz_file_info64 fileInfo;
-	unzFile archive = dukzip_unz_from_this(ctx);
+done:
+	if (archive != NULL) {
+		unzClose(archive);
+	}
+	free(buf);
+	free(path);
 
-	// unzGetCurrentFileInfo(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
-	unzGetCurrentFileInfo64(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
+	DUKZIP_THREAD_RETURN;
+}
 
-#if defined(__GNUC__) && !defined(DUK_NO_VLA)
-	char fileName[fileInfo.size_filename],
-		extraField[fileInfo.size_file_extra],
-		commentString[fileInfo.size_file_comment];
-#else
-	char *fileName = malloc(fileInfo.size_filename); 
-	char *extraField = malloc(fileInfo.size_file_extra); 
-	char *commentString = malloc(fileInfo.size_file_comment);
-#endif
+static duk_ret_t dukzip_unz_extractall(duk_context *ctx) {
+	dukzip_thread threads[DUKZIP_MAX_THREADS];
+	dukzip_extract_batch batch;
+	size_t reported = 0, i;
+	int nthreads, started, failed = 0;
+
+	dukzip_unz_from_this(ctx);
+	memset(&batch, 0, sizeof(batch));
+	batch.dest = duk_require_string(ctx, 0);
+	batch.index = dukzip_unz_index_from_this(ctx);
+	if (batch.index == NULL) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "archive has no index");
+		return -1;
+	}
 
-	// unzGetCurrentFileInfo(archive, &fileInfo, 
-	// 	fileName, fileInfo.size_filename,
-	// 	extraField, fileInfo.size_file_extra,
-	// 	commentString, fileInfo.size_file_comment);
-	unzGetCurrentFileInfo64(archive, &fileInfo, 
-		fileName, fileInfo.size_filename,
-		extraField, fileInfo.size_file_extra,
-		commentString, fileInfo.size_file_comment);
+	duk_push_this(ctx);
+	duk_get_prop_string(ctx, -1, ZIPFILENAME_PROP);
+	batch.path = duk_require_string(ctx, -1);
+	duk_get_prop_string(ctx, -2, ZIPMEM_PROP);
+	batch.mem = duk_get_pointer(ctx, -1);
+	duk_pop_3(ctx);
+
+	for (i = 0; i < batch.index->count; i++) {
+		dukzip_index_entry *e = &batch.index->entries[i];
+		if (!dukzip_safe_name(batch.index->names + e->name, e->namelen)) {
+			duk_push_lstring(ctx, batch.index->names + e->name, e->namelen);
+			duk_error(ctx, DUK_ERR_ERROR, "refusing to extract '%s' outside of the destination", duk_get_string(ctx, -1));
+			return -1;
+		}
+	}
 
-	info_obj = duk_push_object(ctx);
+	if (dukzip_mkdir(batch.dest) != 0 && errno != EEXIST) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not create directory '%s': %s", batch.dest, strerror(errno));
+		return -1;
+	}
 
-	duk_push_int(ctx, fileInfo.compressed_size);
-	duk_put_prop_string(ctx, info_obj, "compressed");
+	batch.finished = duk_push_fixed_buffer(ctx, (batch.index->count + 1) * sizeof(size_t));
+	nthreads = dukzip_get_threads(ctx, 1);
+	if ((size_t) nthreads > batch.index->count) {
+		nthreads = batch.index->count > 0 ? (int) batch.index->count : 1;
+	}
 
-	duk_push_int(ctx, fileInfo.uncompressed_size);
-	duk_put_prop_string(ctx, info_obj, "uncompressed");
+	if (duk_is_object(ctx, 1)) {
+		duk_get_prop_string(ctx, 1, "progress");
+	} else {
+		duk_push_undefined(ctx);
+	}
+	if (!duk_is_function(ctx, -1)) {
+		duk_pop(ctx);
+		duk_push_undefined(ctx);
+	}
 
-	duk_push_lstring(ctx, fileName, fileInfo.size_filename);
-	duk_put_prop_string(ctx, info_obj, "filename");
+	dukzip_mutex_init(&batch.lock);
+	dukzip_cond_init(&batch.done_cond);
+	started = dukzip_start_threads(threads, nthreads, dukzip_extract_worker, &batch);
+	if (started == 0) {
+		dukzip_extract_worker(&batch);
+	}
 
-	duk_push_lstring(ctx, extraField, fileInfo.size_file_extra);
-	duk_put_prop_string(ctx, info_obj, "extra");
+	/* report finished entries until all are done or a worker failed */
+	dukzip_mutex_lock(&batch.lock);
+	while (reported < batch.index->count && !batch.abort) {
+		while (reported == batch.nfinished && !batch.abort) {
+			dukzip_cond_wait(&batch.done_cond, &batch.lock);
+		}
 
-	duk_push_lstring(ctx, commentString, fileInfo.size_file_comment);
-	duk_put_prop_string(ctx, info_obj, "comment");
+		while (reported < batch.nfinished && !batch.abort) {
+			dukzip_index_entry *e = &batch.index->entries[batch.finished[reported++]];
 
-#if !defined(__GNUC__) || defined(DUK_NO_VLA)
-	free(fileName);
-	free(extraField);
-	free(commentString);
-#endif
+			if (duk_is_undefined(ctx, -1)) {
+				continue;
+			}
 
-	return 1;
-}
+			/* the heap is only used by this thread, so the callback runs unlocked */
+			dukzip_mutex_unlock(&batch.lock);
+			duk_dup(ctx, -1);
+			duk_push_lstring(ctx, batch.index->names + e->name, e->namelen);
+			duk_push_number(ctx, (duk_double_t) reported);
+			duk_push_number(ctx, (duk_double_t) batch.index->count);
+			if (duk_pcall(ctx, 3) != DUK_EXEC_SUCCESS) {
+				failed = 1;
+			}
+			dukzip_mutex_lock(&batch.lock);
 
-static duk_ret_t dukzip_unz_readfile(duk_context *ctx) {
-	unz_file_info fileInfo;
-	unzFile archive = dukzip_unz_from_this(ctx);
-	int ret = UNZ_OK;
+			if (failed) {
+				batch.abort = 1;
+				break;
+			}
+			duk_pop(ctx);
+		}
+	}
+	batch.abort = 1;
+	dukzip_mutex_unlock(&batch.lock);
 
-	unzGetCurrentFileInfo(archive, &fileInfo, NULL, 0, NULL, 0, NULL, 0);
-	void *bytes = duk_push_fixed_buffer(ctx, fileInfo.uncompressed_size);
+	dukzip_join_threads(threads, started);
+	dukzip_cond_destroy(&batch.done_cond);
+	dukzip_mutex_destroy(&batch.lock);
 
-	ret = unzOpenCurrentFile(archive);
-	if (ret != UNZ_OK) {
-		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "unable to open file in archive");
+	if (failed) {
+		duk_throw(ctx); /* error of the progress callback */
 		return -1;
 	}
-
-	ret = unzReadCurrentFile(archive, bytes, fileInfo.uncompressed_size);
-	if (ret < 0) {
-		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "unable to read file in archive");
+	if (batch.error[0] != '\0') {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "%s", batch.error);
 		return -1;
 	}
-	unzCloseCurrentFile(archive);
 
+	duk_push_number(ctx, (duk_double_t) batch.nfinished);
 	return 1;
 }
 
@@ -266,7 +1333,7 @@ static zipFile dukzip_require_zip(duk_context *ctx, int index) {
 static zipFile dukzip_zip_from_this(duk_context *ctx) {
 	zipFile f;
 	duk_push_this(ctx);
-	f = dukzip_require_unz(ctx, -1);
+	f = dukzip_require_zip(ctx, -1);
 	duk_pop(ctx);
 	return f;
 }
@@ -287,12 +1354,60 @@ static void dukzip_push_zipfile(duk_context *ctx, zipFile archive, const char *f
 }
 
 static duk_ret_t dukzip_zip_finalizer(duk_context *ctx) {
-	zipFile archive = dukzip_require_zip(ctx, 0);
-	zipClose(archive, "");
+	zipFile archive;
+	dukzip_mem *mem;
+
+	/* NULL if the archive was finished */
+	duk_get_prop_string(ctx, 0, ZIPHANDLE_PROP);
+	archive = duk_get_pointer(ctx, -1);
+	if (archive != NULL) {
+		zipClose(archive, "");
+	}
+
+	duk_get_prop_string(ctx, 0, ZIPMEM_PROP);
+	mem = duk_get_pointer(ctx, -1);
+	if (mem != NULL) {
+		free(mem->data);
+		free(mem);
+	}
 
 	return 0;
 }
 
+/* finish([comment]) : writes the central directory and closes the archive, returns the data of in-memory archives */
+static duk_ret_t dukzip_zip_finish(duk_context *ctx) {
+	zipFile archive = dukzip_zip_from_this(ctx);
+	const char *comment = duk_is_string(ctx, 0) ? duk_get_string(ctx, 0) : NULL;
+	dukzip_mem *mem;
+	int res;
+
+	res = zipClose(archive, comment);
+
+	duk_push_this(ctx);
+	duk_push_pointer(ctx, NULL);
+	duk_put_prop_string(ctx, -2, ZIPHANDLE_PROP);
+
+	if (res != ZIP_OK) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not finish archive (error code %d)", res);
+		return -1;
+	}
+
+	duk_get_prop_string(ctx, -1, ZIPMEM_PROP);
+	mem = duk_get_pointer(ctx, -1);
+	if (mem == NULL) {
+		return 0;
+	}
+
+	memcpy(duk_push_fixed_buffer(ctx, (duk_size_t) mem->size), mem->data, (size_t) mem->size);
+
+	duk_push_pointer(ctx, NULL);
+	duk_put_prop_string(ctx, -4, ZIPMEM_PROP);
+	free(mem->data);
+	free(mem);
+
+	return 1;
+}
+
 /* ---------------------------------------------------------- */
 
 /*
@@ -343,6 +1458,20 @@ static void dukzip_zip_checkoptions(duk_context *ctx, duk_idx_t idx, const char
 	}
 }
 
+/* write data to the current file (zipWriteInFileInZip takes an unsigned length) */
+static int dukzip_zip_writedata(zipFile archive, const void *data, duk_size_t len) {
+	const char *p = data;
+	int res = ZIP_OK;
+
+	while (res == ZIP_OK && len > 0) {
+		unsigned chunk = (len > 0x40000000) ? 0x40000000 : (unsigned) len;
+		res = zipWriteInFileInZip(archive, p, chunk);
+		p += chunk;
+		len -= chunk;
+	}
+	return res;
+}
+
 /*
 Low-level file writing
 
@@ -386,17 +1515,17 @@ static duk_ret_t dukzip_zip_write(duk_context *ctx) {
 
 	if (duk_is_string(ctx, 0)) {
 
-		int outputl = 0;
+		duk_size_t outputl = 0;
 		const char *output = duk_get_lstring(ctx, 0, &outputl);
 
-		res = zipWriteInFileInZip(archive, output, outputl);
+		res = dukzip_zip_writedata(archive, output, outputl);
 
 	} else if (duk_is_buffer(ctx, 0) || duk_is_object(ctx, 0)) {
 
-		int outputl = 0;
+		duk_size_t outputl = 0;
 		void *output = duk_require_buffer_data(ctx, 0, &outputl);
 
-		res = zipWriteInFileInZip(archive, output, outputl);
+		res = dukzip_zip_writedata(archive, output, outputl);
 
 	} else {
 		duk_error(ctx, DUK_ERR_TYPE_ERROR, "unable to write argument to zip file (supported types: string, buffer)");
@@ -445,7 +1574,7 @@ static duk_ret_t dukzip_zip_add(duk_context *ctx) {
 	duk_int_t method = Z_DEFLATED;
 	const char *comment = "";
 
-	int datalen = 0;
+	duk_size_t datalen = 0;
 	void *data = NULL;
 
 	if (duk_is_object(ctx, 0)) {
@@ -486,7 +1615,7 @@ static duk_ret_t dukzip_zip_add(duk_context *ctx) {
 		goto error;
 	}
 
-	res = zipWriteInFileInZip(archive, data, datalen);
+	res = dukzip_zip_writedata(archive, data, datalen);
 	if (res != ZIP_OK) {
 		goto error;
 	}
@@ -509,11 +1638,283 @@ error:
 }
 
 
+/*
+Parallel batch adding
+
+addAll(entries, [options]) takes an array of objects like the ones add
+accepts ({ filename, data, level, method, comment }). Worker threads deflate
+the entries (raw deflate plus CRC, nothing touches the heap), while this
+thread writes the finished streams into the archive in order with minizip's
+raw mode. options.threads sets the number of workers (the number of CPUs
+by default). Returns the number of entries added.
+*/
+
+typedef struct {
+	/* input, filled in on the Duktape thread */
+	const char *filename;
+	const char *comment;
+	const unsigned char *data;
+	duk_size_t size;
+	int level, method;
+
+	/* output of the workers */
+	unsigned char *out;
+	duk_size_t outsize;
+	uLong crc;
+	int done; /* 1 when compressed, -1 on errors */
+} dukzip_add_job;
+
+typedef struct {
+	dukzip_add_job *jobs;
+	duk_size_t count, next;
+	int abort;
+	dukzip_mutex lock;
+	dukzip_cond done_cond;
+} dukzip_add_batch;
+
+/* compress one entry, returns 0 on success */
+static int dukzip_deflate_job(dukzip_add_job *job) {
+	duk_size_t left = job->size;
+	const unsigned char *in = job->data;
+	z_stream zs;
+	uLong crc = crc32(0L, Z_NULL, 0);
+	int res;
+
+	/* crc32 takes an uInt length */
+	while (left > 0) {
+		uInt chunk = (left > 0x40000000) ? 0x40000000 : (uInt) left;
+		crc = crc32(crc, in, chunk);
+		in += chunk;
+		left -= chunk;
+	}
+	job->crc = crc;
+
+	if (job->method != Z_DEFLATED) {
+		/* stored entries are written straight from the input */
+		return 0;
+	}
+
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, job->level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return -1;
+	}
+
+	job->outsize = deflateBound(&zs, (uLong) job->size);
+	if (job->size > 0x40000000 || job->outsize < job->size) {
+		/* deflateBound only covers uLong sizes; leave room for stored blocks */
+		job->outsize = job->size + job->size / 1000 + 1024;
+	}
+	job->out = malloc(job->outsize);
+	if (job->out == NULL) {
+		deflateEnd(&zs);
+		return -1;
+	}
+
+	in = job->data;
+	left = job->size;
+	zs.next_out = job->out;
+	do {
+		uInt chunk = (left > 0x40000000) ? 0x40000000 : (uInt) left;
+		int flush;
+
+		zs.next_in = (Bytef *) in;
+		zs.avail_in = chunk;
+		in += chunk;
+		left -= chunk;
+		flush = (left == 0) ? Z_FINISH : Z_NO_FLUSH;
+
+		/* avail_out is capped as well, so refill it until the piece is consumed (and the stream ended) */
+		do {
+			duk_size_t outleft = job->outsize - (duk_size_t) (zs.next_out - job->out);
+
+			if (outleft == 0) {
+				res = Z_BUF_ERROR;
+				break;
+			}
+			zs.avail_out = (outleft > 0x40000000) ? 0x40000000 : (uInt) outleft;
+
+			res = deflate(&zs, flush);
+		} while (res == Z_OK && (zs.avail_in != 0 || flush == Z_FINISH));
+	} while (left > 0 && res == Z_OK);
+
+	job->outsize = (duk_size_t) (zs.next_out - job->out);
+	deflateEnd(&zs);
+
+	return (res == Z_STREAM_END) ? 0 : -1;
+}
+
+DUKZIP_THREAD_FUNC(dukzip_add_worker) {
+	dukzip_add_batch *batch = arg;
+
+	for (;;) {
+		dukzip_add_job *job;
+		int res;
+
+		dukzip_mutex_lock(&batch->lock);
+		if (batch->abort || batch->next == batch->count) {
+			dukzip_mutex_unlock(&batch->lock);
+			break;
+		}
+		job = &batch->jobs[batch->next++];
+		dukzip_mutex_unlock(&batch->lock);
+
+		res = dukzip_deflate_job(job);
+
+		dukzip_mutex_lock(&batch->lock);
+		job->done = (res == 0) ? 1 : -1;
+		dukzip_cond_broadcast(&batch->done_cond);
+		dukzip_mutex_unlock(&batch->lock);
+	}
+
+	DUKZIP_THREAD_RETURN;
+}
+
+/* write a compressed job into the archive, returns a ZIP_ error code */
+static int dukzip_write_job(zipFile archive, dukzip_add_job *job) {
+	zip_fileinfo zi = {0};
+	int res;
+	/* deflate can make poorly compressing data larger, both sizes have to fit the header */
+	duk_size_t largest = (job->method == Z_DEFLATED && job->outsize > job->size) ? job->outsize : job->size;
+
+	res = zipOpenNewFileInZip2_64(archive, job->filename, &zi, NULL, 0, NULL, 0, job->comment,
+		job->method, job->level, 1, largest >= 0xffffffffUL);
+	if (res != ZIP_OK) {
+		return res;
+	}
+
+	if (job->method == Z_DEFLATED) {
+		res = dukzip_zip_writedata(archive, job->out, job->outsize);
+	} else {
+		res = dukzip_zip_writedata(archive, job->data, job->size);
+	}
+
+	if (res == ZIP_OK) {
+		res = zipCloseFileInZipRaw64(archive, (ZPOS64_T) job->size, job->crc);
+	} else {
+		zipCloseFileInZipRaw64(archive, (ZPOS64_T) job->size, job->crc);
+	}
+	return res;
+}
+
+static duk_ret_t dukzip_zip_addall(duk_context *ctx) {
+	zipFile archive = dukzip_zip_from_this(ctx);
+	dukzip_thread threads[DUKZIP_MAX_THREADS];
+	dukzip_add_batch batch;
+	duk_size_t i, written = 0;
+	const char *failed = NULL;
+	int nthreads, started, res = ZIP_OK;
+
+	if (!duk_is_array(ctx, 0)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "array of entries expected");
+		return -1;
+	}
+
+	memset(&batch, 0, sizeof(batch));
+	batch.count = duk_get_length(ctx, 0);
+	if (batch.count == 0) {
+		duk_push_int(ctx, 0);
+		return 1;
+	}
+
+	/* the strings and buffers stay reachable through the entries array while the workers use them */
+	batch.jobs = duk_push_fixed_buffer(ctx, batch.count * sizeof(dukzip_add_job));
+	for (i = 0; i < batch.count; i++) {
+		dukzip_add_job *job = &batch.jobs[i];
+		duk_int_t level = Z_DEFAULT_COMPRESSION, method = Z_DEFLATED;
+
+		job->filename = "";
+		job->comment = "";
+
+		duk_get_prop_index(ctx, 0, (duk_uarridx_t) i);
+		if (!duk_is_object(ctx, -1)) {
+			duk_error(ctx, DUK_ERR_TYPE_ERROR, "entry %d is not an object", (int) i);
+			return -1;
+		}
+		dukzip_zip_checkoptions(ctx, duk_get_top_index(ctx), &job->filename, &level, &method, &job->comment);
+		job->level = level;
+		job->method = method;
+
+		duk_get_prop_string(ctx, -1, "data");
+		if (duk_is_string(ctx, -1)) {
+			job->data = (const unsigned char *) duk_get_lstring(ctx, -1, &job->size);
+		} else if (duk_is_buffer(ctx, -1) || duk_is_object(ctx, -1)) {
+			job->data = duk_require_buffer_data(ctx, -1, &job->size);
+		} else {
+			duk_error(ctx, DUK_ERR_TYPE_ERROR, "unable to write data of '%s' to zip file (supported types: string, buffer)", job->filename);
+			return -1;
+		}
+		duk_pop_2(ctx);
+	}
+
+	nthreads = dukzip_get_threads(ctx, 1);
+	if ((duk_size_t) nthreads > batch.count) {
+		nthreads = (int) batch.count;
+	}
+
+	dukzip_mutex_init(&batch.lock);
+	dukzip_cond_init(&batch.done_cond);
+	started = dukzip_start_threads(threads, nthreads, dukzip_add_worker, &batch);
+
+	if (started == 0) {
+		/* no threads: compress here */
+		dukzip_add_worker(&batch);
+	}
+
+	/* write the entries in order as they are finished */
+	for (i = 0; i < batch.count; i++) {
+		dukzip_add_job *job = &batch.jobs[i];
+
+		dukzip_mutex_lock(&batch.lock);
+		while (job->done == 0) {
+			dukzip_cond_wait(&batch.done_cond, &batch.lock);
+		}
+		dukzip_mutex_unlock(&batch.lock);
+
+		res = (job->done > 0) ? dukzip_write_job(archive, job) : ZIP_INTERNALERROR;
+		free(job->out);
+		job->out = NULL;
+
+		if (res != ZIP_OK) {
+			failed = job->filename;
+			break;
+		}
+		written++;
+	}
+
+	dukzip_mutex_lock(&batch.lock);
+	batch.abort = 1;
+	dukzip_mutex_unlock(&batch.lock);
+	dukzip_join_threads(threads, started);
+
+	dukzip_cond_destroy(&batch.done_cond);
+	dukzip_mutex_destroy(&batch.lock);
+
+	/* jobs taken before the abort may still hold output */
+	for (i = 0; i < batch.count; i++) {
+		free(batch.jobs[i].out);
+	}
+
+	if (failed != NULL) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not write file '%s' (error code %d)", failed, res);
+		return -1;
+	}
+
+	duk_push_number(ctx, (duk_double_t) written);
+	return 1;
+}
+
 /* ---------------------------------------------------------- */
 
+/*
+open(path, [mode]) opens an archive file for reading ('r', the default) or
+writing ('w'). open(buffer) reads an archive held in a buffer, which is
+kept alive by the archive object; open(null, 'w') writes an archive in
+memory, whose data is returned by finish().
+*/
 static duk_ret_t dukzip_open(duk_context *ctx) {
-	const char *filename = duk_require_string(ctx, 0);
+	const char *filename;
 	const char *filemode;
+	dukzip_mem *mem = NULL;
 
 	if (duk_is_string(ctx, 1)) {
 		filemode = duk_require_string(ctx, 1);
@@ -521,33 +1922,85 @@ static duk_ret_t dukzip_open(duk_context *ctx) {
 		filemode = "r";
 	}
 
+	if (!duk_is_string(ctx, 0)) {
+		filename = "";
+
+		if (filemode[0] == 'r') {
+			duk_size_t size;
+			void *data = duk_require_buffer_data(ctx, 0, &size);
+
+			mem = calloc(1, sizeof(dukzip_mem));
+			if (mem == NULL) {
+				duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not allocate archive");
+				return -1;
+			}
+			mem->data = data;
+			mem->size = size;
+		} else {
+			mem = calloc(1, sizeof(dukzip_mem));
+			if (mem == NULL) {
+				duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not allocate archive");
+				return -1;
+			}
+			mem->growable = 1;
+		}
+	} else {
+		filename = duk_require_string(ctx, 0);
+	}
+
 	if (filemode[0] == 'r') {
 
 		unzFile archive;
 
-		archive = unzOpen64(filename);
+		archive = dukzip_unz_open(filename, mem);
 		if (archive == NULL) {
+			if (mem != NULL) {
+				free(mem);
+				duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "buffer is not a zip archive");
+				return -1;
+			}
 			duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not open file '%s'", filename);
 			return -1;
 		}
 		
 		dukzip_push_unzfile(ctx, archive, filename);
+		if (mem != NULL) {
+			duk_push_pointer(ctx, mem);
+			duk_put_prop_string(ctx, -2, ZIPMEM_PROP);
+			duk_dup(ctx, 0);
+			duk_put_prop_string(ctx, -2, ZIPMEM_SOURCE_PROP);
+		}
 		return 1;
 
 	} else if (filemode[0] == 'w') {
 
 		zipFile archive;
 
-		archive = zipOpen64(filename, APPEND_STATUS_CREATE);
+		if (mem != NULL) {
+			zlib_filefunc64_def ff;
+			dukzip_mem_filefunc(&ff);
+			archive = zipOpen2_64(mem, APPEND_STATUS_CREATE, NULL, &ff);
+		} else {
+			archive = zipOpen64(filename, APPEND_STATUS_CREATE);
+		}
 		if (archive == NULL) {
+			if (mem != NULL) {
+				free(mem->data);
+				free(mem);
+			}
 			duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not open file '%s'", filename);
 			return -1;
 		}
 
 		dukzip_push_zipfile(ctx, archive, filename);
+		if (mem != NULL) {
+			duk_push_pointer(ctx, mem);
+			duk_put_prop_string(ctx, -2, ZIPMEM_PROP);
+		}
 		return 1;
 
 	} else {
+		free(mem);
 		duk_error(ctx, DUK_ERR_TYPE_ERROR, "%s is not a valid file mode (valid modes: 'r' or 'w')", filemode);
 		return -1;
 	}
@@ -560,9 +2013,20 @@ static const duk_function_list_entry dukzip_unz_prototype[] = {
 	{ "getFirstFile", dukzip_unz_getfirstfile, 0 },
 	{ "getNextFile", dukzip_unz_getnextfile, 0 },
 	{ "getFile", dukzip_unz_getfile, 1 },
+	{ "stat", dukzip_unz_stat, 1 },
 	{ "getFileName", dukzip_unz_getfilename, 0 },
 	{ "getFileInfo", dukzip_unz_getfileinfo, 0 },
 	{ "readFile", dukzip_unz_readfile, 0 },
+	{ "openEntry", dukzip_unz_openentry, 1 },
+	{ "extractAll", dukzip_unz_extractall, 2 },
+	{ NULL, NULL, 0 }
+};
+
+static const duk_function_list_entry dukzip_entry_prototype[] = {
+	{ "read", dukzip_entry_read, 1 },
+	{ "readInto", dukzip_entry_readinto, 3 },
+	{ "pipe", dukzip_entry_pipe, 2 },
+	{ "close", dukzip_entry_close, 0 },
 	{ NULL, NULL, 0 }
 };
 
@@ -571,6 +2035,8 @@ static const duk_function_list_entry dukzip_zip_prototype[] = {
 	{ "write", dukzip_zip_write, 1 },
 	{ "close", dukzip_zip_close, 0 },
 	{ "add", dukzip_zip_add, 3 },
+	{ "addAll", dukzip_zip_addall, 2 },
+	{ "finish", dukzip_zip_finish, 1 },
 	{ NULL, NULL, 0 }
 };
 
@@ -597,6 +2063,11 @@ static int dukzip_core(duk_context *ctx) {
 	duk_put_function_list(ctx, -1, dukzip_zip_prototype);
 	duk_put_global_string(ctx, DUKZIP_ZIP_PROTOTYPE);
 
+	/* create entry reader prototype (entries are closed with their archive) */
+	duk_push_object(ctx);
+	duk_put_function_list(ctx, -1, dukzip_entry_prototype);
+	duk_put_global_string(ctx, DUKZIP_ENTRY_PROTOTYPE);
+
 	duk_put_function_list(ctx, -1, dukzip_module);
 	return mod;
 }
@@ -0,0 +1,514 @@
+/*
+Deflate/inflate library for Duktape.
+
+Uses the vendored zlib. Modelled on the zlib module of Node.js
+see: https://nodejs.org/api/zlib.html
+
+* deflateSync, inflateSync, deflateRawSync, inflateRawSync, gzipSync,
+  gunzipSync and unzipSync (zlib or gzip) take a string or buffer and an
+  optional options object { level, windowBits, memLevel, strategy } and
+  return a buffer; gunzip handles concatenated gzip members
+* createDeflate, createInflate, createDeflateRaw, createInflateRaw,
+  createGzip, createGunzip and createUnzip return streams: write(chunk)
+  emits 'data' with the output so far, end([chunk]) finishes the stream and
+  emits 'end', 'finish' and 'close', and pipe(dest) writes the output to
+  another stream (e.g. a duk-node file stream). process(chunk, [flush])
+  returns the output directly for code that does not want events.
+
+define BUILD_AS_DLL to build as a duktape module.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <duktape.h>
+
+#include <zlib.h>
+
+/* ---------------------------------------------------------- */
+
+/* Object property to hold the stream state */
+#define DZLIB_HANDLE_PROP "$data"
+/* Name of the stream prototype */
+#define DZLIB_STREAM_PROTOTYPE "DzlibStreamPrototype"
+
+/* initial size of output buffers */
+#define DZLIB_CHUNK_SIZE (16 * 1024)
+/* largest piece handed to zlib at once (avail_in and avail_out are uInt) */
+#define DZLIB_MAX_PIECE 0x40000000
+
+#define DZLIB_DEFLATE 0
+#define DZLIB_INFLATE 1
+
+/* formats (window bits are adjusted per format) */
+#define DZLIB_ZLIB 0
+#define DZLIB_GZIP 1
+#define DZLIB_RAW 2
+#define DZLIB_AUTO 3 /* inflate only: zlib or gzip */
+
+typedef struct {
+	z_stream zs;
+	int mode;
+	int format;
+	int ended;   /* inflate reached the end of the stream */
+	int closed;  /* zlib state released */
+} dzlib_stream;
+
+/* ---------------------------------------------------------- */
+
+static int dzlib_get_int_option(duk_context *ctx, duk_idx_t idx, const char *name, int def, int min, int max) {
+	int value = def;
+
+	if (duk_is_object(ctx, idx)) {
+		duk_get_prop_string(ctx, idx, name);
+		if (duk_is_number(ctx, -1)) {
+			value = duk_get_int(ctx, -1);
+			if (value < min || value > max) {
+				duk_error(ctx, DUK_ERR_RANGE_ERROR, "invalid %s %d (expected %d to %d)", name, value, min, max);
+			}
+		}
+		duk_pop(ctx);
+	}
+	return value;
+}
+
+/* initialize s for mode and format with the options object at idx */
+static void dzlib_init(duk_context *ctx, dzlib_stream *s, int mode, int format, duk_idx_t idx) {
+	int level = dzlib_get_int_option(ctx, idx, "level", Z_DEFAULT_COMPRESSION, -1, 9);
+	int bits = dzlib_get_int_option(ctx, idx, "windowBits", MAX_WBITS, 8, MAX_WBITS);
+	int memlevel = dzlib_get_int_option(ctx, idx, "memLevel", 8, 1, MAX_MEM_LEVEL);
+	int strategy = dzlib_get_int_option(ctx, idx, "strategy", Z_DEFAULT_STRATEGY, Z_DEFAULT_STRATEGY, Z_FIXED);
+	int res;
+
+	switch (format) {
+	case DZLIB_GZIP: bits += 16; break;
+	case DZLIB_RAW: bits = -bits; break;
+	case DZLIB_AUTO: bits += 32; break;
+	}
+
+	memset(s, 0, sizeof(dzlib_stream));
+	s->mode = mode;
+	s->format = format;
+
+	if (mode == DZLIB_DEFLATE) {
+		/* zlib 1.2.8 refuses raw deflate with 8 bits */
+		if (bits == -8) {
+			bits = -9;
+		}
+		res = deflateInit2(&s->zs, level, Z_DEFLATED, bits, memlevel, strategy);
+	} else {
+		res = inflateInit2(&s->zs, bits);
+	}
+
+	if (res != Z_OK) {
+		s->closed = 1;
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not initialize zlib (error code %d)", res);
+	}
+}
+
+static void dzlib_end(dzlib_stream *s) {
+	if (!s->closed) {
+		if (s->mode == DZLIB_DEFLATE) {
+			deflateEnd(&s->zs);
+		} else {
+			inflateEnd(&s->zs);
+		}
+		s->closed = 1;
+	}
+}
+
+/* get the bytes of a string or buffer */
+static const unsigned char *dzlib_require_data(duk_context *ctx, duk_idx_t idx, duk_size_t *len) {
+	if (duk_is_undefined(ctx, idx) || duk_is_null(ctx, idx)) {
+		*len = 0;
+		return (const unsigned char *) "";
+	}
+	if (duk_is_string(ctx, idx)) {
+		return (const unsigned char *) duk_get_lstring(ctx, idx, len);
+	}
+	return duk_require_buffer_data(ctx, idx, len);
+}
+
+/*
+Run in through the stream and push a buffer with the output. Returns Z_OK,
+or a zlib error code (the error message is in s->zs.msg) with the partial
+output pushed.
+*/
+static int dzlib_process(duk_context *ctx, dzlib_stream *s, const unsigned char *in, duk_size_t len, int flush) {
+	duk_size_t cap = DZLIB_CHUNK_SIZE, used = 0, left = len;
+	unsigned char *out;
+	int res = Z_OK;
+
+	if (s->mode == DZLIB_DEFLATE && len > cap) {
+		cap = len / 2;
+	} else if (s->mode == DZLIB_INFLATE && len * 4 > cap) {
+		cap = len * 4;
+	}
+	out = duk_push_dynamic_buffer(ctx, cap);
+
+	s->zs.next_in = (Bytef *) in;
+	s->zs.avail_in = 0;
+
+	for (;;) {
+		duk_size_t room;
+		int last, piece_flush;
+
+		/* feed the input in pieces zlib can take */
+		if (s->zs.avail_in == 0 && left > 0) {
+			uInt piece = (left > DZLIB_MAX_PIECE) ? DZLIB_MAX_PIECE : (uInt) left;
+			s->zs.avail_in = piece;
+			left -= piece;
+		}
+		last = (left == 0);
+		piece_flush = last ? flush : Z_NO_FLUSH;
+
+		if (used == cap) {
+			cap *= 2;
+			out = duk_resize_buffer(ctx, -1, cap);
+		}
+		room = cap - used;
+		s->zs.next_out = out + used;
+		s->zs.avail_out = (room > DZLIB_MAX_PIECE) ? DZLIB_MAX_PIECE : (uInt) room;
+
+		if (s->mode == DZLIB_DEFLATE) {
+			res = deflate(&s->zs, piece_flush);
+		} else if (s->ended) {
+			/* data after the end of the stream is ignored */
+			s->zs.avail_in = 0;
+			left = 0;
+			res = Z_STREAM_END;
+		} else {
+			res = inflate(&s->zs, Z_NO_FLUSH);
+		}
+		used = (duk_size_t) (s->zs.next_out - out);
+
+		if (res == Z_STREAM_END) {
+			if (s->mode == DZLIB_DEFLATE) {
+				res = Z_OK;
+				break;
+			}
+
+			/* gzip streams may hold several members */
+			if ((s->format == DZLIB_GZIP || s->format == DZLIB_AUTO) && s->zs.avail_in > 0 && s->zs.next_in[0] == 0x1f) {
+				inflateReset(&s->zs);
+				continue;
+			}
+			s->ended = 1;
+			if (s->zs.avail_in == 0 && left == 0) {
+				res = Z_OK;
+				break;
+			}
+			continue;
+		}
+
+		if (res == Z_BUF_ERROR) {
+			/* no progress possible: more output room or more input needed */
+			if (s->zs.avail_out == 0) {
+				continue;
+			}
+			if (s->zs.avail_in == 0 && left == 0) {
+				res = Z_OK;
+				break;
+			}
+			continue;
+		}
+
+		if (res != Z_OK) {
+			break;
+		}
+
+		/* done when all input was taken and zlib did not fill the output */
+		if (s->zs.avail_in == 0 && last && s->zs.avail_out != 0 && !(s->mode == DZLIB_DEFLATE && flush == Z_FINISH)) {
+			break;
+		}
+	}
+
+	s->zs.next_in = NULL;
+	s->zs.next_out = NULL;
+	duk_resize_buffer(ctx, -1, used);
+
+	return res;
+}
+
+static void dzlib_error(duk_context *ctx, dzlib_stream *s, int res) {
+	const char *msg = s->zs.msg ? s->zs.msg : "unexpected end of file";
+	duk_error(ctx, DUK_ERR_ERROR, "zlib error: %s (error code %d)", msg, res);
+}
+
+/* ---------------------------------------------------------- */
+
+/* one-shot conversion of the data at index 0 with the options at index 1 */
+static duk_ret_t dzlib_sync(duk_context *ctx, int mode, int format) {
+	dzlib_stream s;
+	duk_size_t len;
+	const unsigned char *in;
+	int res;
+
+	if (duk_is_undefined(ctx, 0) || duk_is_null(ctx, 0)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "string or buffer expected");
+		return -1;
+	}
+	in = dzlib_require_data(ctx, 0, &len);
+
+	dzlib_init(ctx, &s, mode, format, 1);
+	res = dzlib_process(ctx, &s, in, len, Z_FINISH);
+	if (res == Z_OK && mode == DZLIB_INFLATE && !s.ended) {
+		res = Z_BUF_ERROR;
+	}
+
+	dzlib_end(&s);
+	if (res != Z_OK) {
+		dzlib_error(ctx, &s, res);
+		return -1;
+	}
+	return 1;
+}
+
+static duk_ret_t dzlib_deflate_sync(duk_context *ctx) {
+	return dzlib_sync(ctx, DZLIB_DEFLATE, DZLIB_ZLIB);
+}
+
+static duk_ret_t dzlib_inflate_sync(duk_context *ctx) {
+	return dzlib_sync(ctx, DZLIB_INFLATE, DZLIB_ZLIB);
+}
+
+static duk_ret_t dzlib_deflate_raw_sync(duk_context *ctx) {
+	return dzlib_sync(ctx, DZLIB_DEFLATE, DZLIB_RAW);
+}
+
+static duk_ret_t dzlib_inflate_raw_sync(duk_context *ctx) {
+	return dzlib_sync(ctx, DZLIB_INFLATE, DZLIB_RAW);
+}
+
+static duk_ret_t dzlib_gzip_sync(duk_context *ctx) {
+	return dzlib_sync(ctx, DZLIB_DEFLATE, DZLIB_GZIP);
+}
+
+static duk_ret_t dzlib_gunzip_sync(duk_context *ctx) {
+	return dzlib_sync(ctx, DZLIB_INFLATE, DZLIB_GZIP);
+}
+
+static duk_ret_t dzlib_unzip_sync(duk_context *ctx) {
+	return dzlib_sync(ctx, DZLIB_INFLATE, DZLIB_AUTO);
+}
+
+/* ---------------------------------------------------------- */
+
+static dzlib_stream *dzlib_stream_from_this(duk_context *ctx) {
+	dzlib_stream *s;
+
+	duk_push_this(ctx);
+	duk_get_prop_string(ctx, -1, DZLIB_HANDLE_PROP);
+	s = duk_get_pointer(ctx, -1);
+	duk_pop_2(ctx);
+
+	if (s == NULL) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "Expected zlib stream");
+		return NULL;
+	}
+	if (s->closed) {
+		duk_error(ctx, DUK_ERR_ERROR, "zlib stream has ended");
+		return NULL;
+	}
+	return s;
+}
+
+static duk_ret_t dzlib_stream_finalizer(duk_context *ctx) {
+	dzlib_stream *s;
+
+	duk_get_prop_string(ctx, 0, DZLIB_HANDLE_PROP);
+	s = duk_get_pointer(ctx, -1);
+	if (s) {
+		dzlib_end(s);
+		free(s);
+	}
+	return 0;
+}
+
+static duk_ret_t dzlib_create(duk_context *ctx, int mode, int format) {
+	dzlib_stream *s = malloc(sizeof(dzlib_stream));
+	if (s == NULL) {
+		duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not allocate zlib stream");
+		return -1;
+	}
+
+	/* the object owns s before anything can throw */
+	duk_push_object(ctx);
+	duk_get_global_string(ctx, DZLIB_STREAM_PROTOTYPE);
+	duk_set_prototype(ctx, -2);
+	s->closed = 1;
+	duk_push_pointer(ctx, s);
+	duk_put_prop_string(ctx, -2, DZLIB_HANDLE_PROP);
+
+	dzlib_init(ctx, s, mode, format, 0);
+	return 1;
+}
+
+static duk_ret_t dzlib_create_deflate(duk_context *ctx) {
+	return dzlib_create(ctx, DZLIB_DEFLATE, DZLIB_ZLIB);
+}
+
+static duk_ret_t dzlib_create_inflate(duk_context *ctx) {
+	return dzlib_create(ctx, DZLIB_INFLATE, DZLIB_ZLIB);
+}
+
+static duk_ret_t dzlib_create_deflate_raw(duk_context *ctx) {
+	return dzlib_create(ctx, DZLIB_DEFLATE, DZLIB_RAW);
+}
+
+static duk_ret_t dzlib_create_inflate_raw(duk_context *ctx) {
+	return dzlib_create(ctx, DZLIB_INFLATE, DZLIB_RAW);
+}
+
+static duk_ret_t dzlib_create_gzip(duk_context *ctx) {
+	return dzlib_create(ctx, DZLIB_DEFLATE, DZLIB_GZIP);
+}
+
+static duk_ret_t dzlib_create_gunzip(duk_context *ctx) {
+	return dzlib_create(ctx, DZLIB_INFLATE, DZLIB_GZIP);
+}
+
+static duk_ret_t dzlib_create_unzip(duk_context *ctx) {
+	return dzlib_create(ctx, DZLIB_INFLATE, DZLIB_AUTO);
+}
+
+/* stream.process(chunk, [flush]) : returns the output for chunk (Z_FINISH ends the stream) */
+static duk_ret_t dzlib_stream_process(duk_context *ctx) {
+	dzlib_stream *s = dzlib_stream_from_this(ctx);
+	int flush = duk_is_number(ctx, 1) ? duk_get_int(ctx, 1) : Z_NO_FLUSH;
+	duk_size_t len;
+	const unsigned char *in = dzlib_require_data(ctx, 0, &len);
+	int res;
+
+	if (flush != Z_NO_FLUSH && flush != Z_SYNC_FLUSH && flush != Z_FULL_FLUSH && flush != Z_FINISH) {
+		duk_error(ctx, DUK_ERR_RANGE_ERROR, "invalid flush mode %d", flush);
+		return -1;
+	}
+
+	res = dzlib_process(ctx, s, in, len, flush);
+	if (res == Z_OK && flush == Z_FINISH && s->mode == DZLIB_INFLATE && !s->ended) {
+		res = Z_BUF_ERROR;
+	}
+
+	if (flush == Z_FINISH || res != Z_OK) {
+		dzlib_end(s);
+	}
+	if (res != Z_OK) {
+		dzlib_error(ctx, s, res);
+		return -1;
+	}
+	return 1;
+}
+
+/*
+------------------------------------------------------------------------------------
+Events (same emitter as the duk-node file streams)
+*/
+
+static const char _dzlib_src[] = "(function (proto, Z_NO_FLUSH, Z_SYNC_FLUSH, Z_FINISH) {"
+	"proto.on = proto.addListener = function (name, fn) { var ev = this._events || (this._events = {}); (ev[name] || (ev[name] = [])).push(fn); return this; };"
+	"proto.once = function (name, fn) { var self = this; function g() { self.removeListener(name, g); fn.apply(self, arguments); } g.listener = fn; return this.on(name, g); };"
+	"proto.removeListener = function (name, fn) { var l = this._events && this._events[name]; if (l) { for (var i = 0; i < l.length; i++) { if (l[i] === fn || l[i].listener === fn) { l.splice(i, 1); break; } } } return this; };"
+	"proto.emit = function (name) { var l = this._events && this._events[name]; if (!l || !l.length) { if (name === 'error') { throw arguments[1]; } return false; }"
+		"var args = Array.prototype.slice.call(arguments, 1); l = l.slice(); for (var i = 0; i < l.length; i++) { l[i].apply(this, args); } return true; };"
+	"proto._run = function (chunk, flush) { var out; try { out = this.process(chunk, flush); } catch (e) { this.emit('error', e); return false; }"
+		"if (out.length > 0) { this.emit('data', out); } return true; };"
+	"proto.write = function (chunk) { this._run(chunk, Z_NO_FLUSH); return true; };"
+	"proto.flush = function () { this._run(null, Z_SYNC_FLUSH); return this; };"
+	"proto.end = function (chunk) { if (chunk !== undefined && chunk !== null) { this.write(chunk); }"
+		"if (this._run(null, Z_FINISH)) { this.emit('end'); this.emit('finish'); this.emit('close'); } return this; };"
+	"proto.pipe = function (dest, options) { this.on('data', function (chunk) { dest.write(chunk); });"
+		"if (!options || options.end !== false) { this.once('end', function () { if (dest.end) { dest.end(); } }); }"
+		"return dest; };"
+"})";
+
+/* ---------------------------------------------------------- */
+
+static const duk_function_list_entry dzlib_stream_prototype[] = {
+	{ "process", dzlib_stream_process, 2 },
+	{ NULL, NULL, 0 }
+};
+
+static const duk_function_list_entry dzlib_module[] = {
+	{ "deflateSync", dzlib_deflate_sync, 2 },
+	{ "inflateSync", dzlib_inflate_sync, 2 },
+	{ "deflateRawSync", dzlib_deflate_raw_sync, 2 },
+	{ "inflateRawSync", dzlib_inflate_raw_sync, 2 },
+	{ "gzipSync", dzlib_gzip_sync, 2 },
+	{ "gunzipSync", dzlib_gunzip_sync, 2 },
+	{ "unzipSync", dzlib_unzip_sync, 2 },
+	{ "createDeflate", dzlib_create_deflate, 1 },
+	{ "createInflate", dzlib_create_inflate, 1 },
+	{ "createDeflateRaw", dzlib_create_deflate_raw, 1 },
+	{ "createInflateRaw", dzlib_create_inflate_raw, 1 },
+	{ "createGzip", dzlib_create_gzip, 1 },
+	{ "createGunzip", dzlib_create_gunzip, 1 },
+	{ "createUnzip", dzlib_create_unzip, 1 },
+	{ NULL, NULL, 0 }
+};
+
+#define REGISTER_CONST(ctx, idx, name) \
+	duk_push_int(ctx, name); \
+	duk_put_prop_string(ctx, idx, #name)
+
+static int dzlib_core(duk_context *ctx) {
+	int mod = duk_push_object(ctx);
+
+	/* create stream prototype */
+	duk_push_object(ctx);
+	duk_push_c_function(ctx, dzlib_stream_finalizer, 1);
+	duk_set_finalizer(ctx, -2);
+	duk_put_function_list(ctx, -1, dzlib_stream_prototype);
+	duk_put_global_string(ctx, DZLIB_STREAM_PROTOTYPE);
+
+	duk_eval_string(ctx, _dzlib_src);
+	duk_get_global_string(ctx, DZLIB_STREAM_PROTOTYPE);
+	duk_push_int(ctx, Z_NO_FLUSH);
+	duk_push_int(ctx, Z_SYNC_FLUSH);
+	duk_push_int(ctx, Z_FINISH);
+	duk_call(ctx, 4);
+	duk_pop(ctx);
+
+	duk_put_function_list(ctx, mod, dzlib_module);
+
+	REGISTER_CONST(ctx, mod, Z_NO_FLUSH);
+	REGISTER_CONST(ctx, mod, Z_SYNC_FLUSH);
+	REGISTER_CONST(ctx, mod, Z_FULL_FLUSH);
+	REGISTER_CONST(ctx, mod, Z_FINISH);
+
+	REGISTER_CONST(ctx, mod, Z_NO_COMPRESSION);
+	REGISTER_CONST(ctx, mod, Z_BEST_SPEED);
+	REGISTER_CONST(ctx, mod, Z_BEST_COMPRESSION);
+	REGISTER_CONST(ctx, mod, Z_DEFAULT_COMPRESSION);
+
+	REGISTER_CONST(ctx, mod, Z_FILTERED);
+	REGISTER_CONST(ctx, mod, Z_HUFFMAN_ONLY);
+	REGISTER_CONST(ctx, mod, Z_RLE);
+	REGISTER_CONST(ctx, mod, Z_FIXED);
+	REGISTER_CONST(ctx, mod, Z_DEFAULT_STRATEGY);
+
+	return mod;
+}
+
+#ifdef BUILD_AS_DLL
+
+#if defined(_WIN32)
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+DLL_EXPORT duk_ret_t dukopen_dzlib(duk_context *ctx) {
+	dzlib_core(ctx);
+	return 1;
+}
+
+#else
+
+void register_dzlib(duk_context *ctx) {
+	dzlib_core(ctx);
+	duk_put_global_string(ctx, "dzlib");
+
+	duk_eval_string_noresult(ctx, "Duktape.modLoaded['dzlib'] = dzlib");
+}
+
+#endif
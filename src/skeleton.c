@@ -2,13 +2,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include "duktape.h"
+#include "dukalloc/dukalloc.h"
 
 static duk_ret_t pmain (duk_context *ctx); /* duktape main function */
 
 int main(int argc, char const *argv[]) {
 	duk_context *ctx = NULL;
+	dukalloc_options alloc_opts;
 
-	ctx = duk_create_heap_default();
+	dukalloc_parse_options(&alloc_opts, &argc, argv);
+	ctx = dukalloc_create_heap(&alloc_opts, NULL);
     if (!ctx) {
         printf("Failed to create a Duktape heap.\n");
         exit(1);
@@ -22,7 +25,7 @@ int main(int argc, char const *argv[]) {
 		exit(1);
 	}
 
-    duk_destroy_heap(ctx);
+    dukalloc_destroy_heap(ctx);
 
 	return 0;
 }
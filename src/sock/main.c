@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "duktape.h"
+#include "../dukalloc/dukalloc.h"
 
 void prepare_duk_env(duk_context *ctx);
 
@@ -9,12 +10,14 @@ void register_sock(duk_context *ctx);
 int main(int argc, const char *argv[]) {
     duk_context *ctx = NULL;
     const char *filename = "main.js";
+    dukalloc_options alloc_opts;
 
 #ifdef DEBUG
     printf("loading Duktape\n");
 #endif
 
-    ctx = duk_create_heap_default();
+    dukalloc_parse_options(&alloc_opts, &argc, argv);
+    ctx = dukalloc_create_heap(&alloc_opts, NULL);
     if (!ctx) {
         printf("Failed to create a Duktape heap.\n");
         exit(1);
@@ -37,7 +40,7 @@ int main(int argc, const char *argv[]) {
     duk_pop(ctx);  /* ignore result */
 
  finished:
-    duk_destroy_heap(ctx);
+    dukalloc_destroy_heap(ctx);
 
     return EXIT_SUCCESS;
 }
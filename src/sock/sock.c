@@ -4,20 +4,114 @@ around with socket programming in a higher-level language.
 
 Based on the following tutorial:
 http://www.binarytides.com/winsock-socket-programming-tutorial/
+
+Notes:
+
+* builds on Winsock2 (Windows) and BSD sockets (POSIX)
+* sockets are passed around as pointers holding the SOCKET / file descriptor
+* in non-blocking mode (setblocking(s, false)) recv and accept return null
+  and send returns the number of bytes sent when the call would block
+* send takes strings, buffers and typed array slices; recvInto fills an
+  existing buffer so that busy loops do not allocate per packet
+* writev(s, chunks) sends an array of chunks with one sendmsg/WSASend call
+* sendFile(s, path|fd, [offset], [length]) lets the kernel send a file
+  (sendfile on Linux, TransmitFile on Windows)
+* poll(fds, timeout) checks an array of { socket, events } once;
+  poller() keeps a set of sockets (epoll on Linux, poll/WSAPoll elsewhere)
+  for programs serving many connections
 */
 
+#define DUK_SOCK_BUFLEN 512
+
+#if defined(_WIN32)
+
 /* Vista or higher compatibility */
 #define WINVER _WIN32_WINNT_VISTA 
 #define _WIN32_WINNT _WIN32_WINNT_VISTA 
 
-#define DUK_SOCK_BUFLEN 512
-
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 
 #include <duktape.h>
 
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#include <mswsock.h>
+#include <io.h>
+
+typedef int socklen_t;
+typedef WSAPOLLFD duk_pollfd;
+
+#define duk_sock_errno() WSAGetLastError()
+#define DUK_SOCK_WOULDBLOCK(e) ((e) == WSAEWOULDBLOCK)
+#define DUK_SOCK_INPROGRESS(e) ((e) == WSAEWOULDBLOCK)
+#define duk_sock_poll WSAPoll
+#define DUK_SOCK_SENDFLAGS 0
+
+#else
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+
+#include <duktape.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+#if !defined(IOV_MAX)
+#define IOV_MAX 1024
+#endif
+
+#if defined(__linux__) && !defined(DUK_SOCK_NO_EPOLL)
+#define DUK_SOCK_USE_EPOLL 1
+#include <sys/epoll.h>
+#endif
+
+typedef int SOCKET;
+typedef struct pollfd duk_pollfd;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+
+#define duk_sock_errno() errno
+#define DUK_SOCK_WOULDBLOCK(e) ((e) == EAGAIN || (e) == EWOULDBLOCK)
+#define DUK_SOCK_INPROGRESS(e) ((e) == EINPROGRESS)
+#define duk_sock_poll poll
+
+/* report EPIPE instead of raising SIGPIPE when the peer is gone */
+#if defined(MSG_NOSIGNAL)
+#define DUK_SOCK_SENDFLAGS MSG_NOSIGNAL
+#else
+#define DUK_SOCK_SENDFLAGS 0
+#endif
+
+#endif
+
+/* sockets are stored in pointers */
+#define duk_push_socket(ctx, s) duk_push_pointer(ctx, (void*) (intptr_t) (s))
+#define duk_require_socket(ctx, idx) ((SOCKET) (intptr_t) duk_require_pointer(ctx, idx))
+
+/* heap stash key of the poller prototype */
+#define DUK_SOCK_POLLER_PROTO "armornick_sock_poller"
 
 
 // ----------------------------------------------------------------------------
@@ -41,11 +135,11 @@ static duk_ret_t duk_socket(duk_context *ctx) {
 
 	s = socket(family, type, protocol);
 	if (s == INVALID_SOCKET) {
-		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not create socket (error code %d)", WSAGetLastError());
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not create socket (error code %d)", duk_sock_errno());
         return -1;
 	}
 
-	duk_push_pointer(ctx, (void*) s);
+	duk_push_socket(ctx, s);
 	return 1;
 }
 
@@ -114,15 +208,21 @@ static duk_ret_t duk_connect(duk_context *ctx) {
 	SOCKET s;
 	struct sockaddr_in server;
 
-	s = (SOCKET) duk_require_pointer(ctx, 0);
+	s = duk_require_socket(ctx, 0);
 	duk_get_sockaddr(ctx, &server);
 
     if (connect(s, (struct sockaddr *)&server, sizeof(server)) < 0) {
-    	duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not connect");
+    	/* non-blocking sockets finish connecting later (poll for POLLOUT) */
+    	if (DUK_SOCK_INPROGRESS(duk_sock_errno())) {
+    		duk_push_false(ctx);
+    		return 1;
+    	}
+    	duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not connect (error code %d)", duk_sock_errno());
         return -1;
     }
 
-    return 0;
+    duk_push_true(ctx);
+    return 1;
 }
 
 static duk_ret_t duk_inetaddr(duk_context *ctx) {
@@ -135,31 +235,342 @@ static duk_ret_t duk_inetaddr(duk_context *ctx) {
 	return 1;
 }
 
+/*
+Get the bytes of a string, buffer or buffer object (including typed array
+slices) at idx, narrowed by the optional offset and length at idx+1 and idx+2.
+*/
+static const char *duk_sock_require_data(duk_context *ctx, duk_idx_t idx, duk_size_t *len) {
+	const char *data;
+	duk_size_t size, offset = 0;
+
+	if (duk_is_string(ctx, idx)) {
+		data = duk_get_lstring(ctx, idx, &size);
+	} else {
+		data = duk_require_buffer_data(ctx, idx, &size);
+	}
+
+	if (duk_is_number(ctx, idx + 1)) {
+		offset = (duk_size_t) duk_require_uint(ctx, idx + 1);
+		if (offset > size) {
+			duk_error(ctx, DUK_ERR_RANGE_ERROR, "offset out of range");
+		}
+	}
+
+	size -= offset;
+	if (duk_is_number(ctx, idx + 2)) {
+		duk_size_t length = (duk_size_t) duk_require_uint(ctx, idx + 2);
+		if (length > size) {
+			duk_error(ctx, DUK_ERR_RANGE_ERROR, "length out of range");
+		}
+		size = length;
+	}
+
+	*len = size;
+	return data + offset;
+}
+
+/* send(s, data, [offset], [length]) : sends a string or buffer, returns the number of bytes sent */
 static duk_ret_t duk_send(duk_context *ctx) {
 	SOCKET s;
 	const char *message;
-	int messagelen;
+	duk_size_t messagelen;
+	int sent;
 
-	s = (SOCKET) duk_require_pointer(ctx, 0);
-	message = duk_require_lstring(ctx, 1, &messagelen);
+	s = duk_require_socket(ctx, 0);
+	message = duk_sock_require_data(ctx, 1, &messagelen);
 
-	if( send(s, message, messagelen, 0) < 0) {
-		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not send message");
-        return -1;
+	if ((sent = send(s, message, (int) messagelen, DUK_SOCK_SENDFLAGS)) < 0) {
+		if (DUK_SOCK_WOULDBLOCK(duk_sock_errno())) {
+			sent = 0;
+		} else {
+			duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not send message (error code %d)", duk_sock_errno());
+	        return -1;
+		}
 	}
 
-	return 0;
+	duk_push_int(ctx, sent);
+	return 1;
+}
+
+/* writev(s, chunks) : sends an array of strings and buffers in one call, returns the number of bytes sent */
+static duk_ret_t duk_writev(duk_context *ctx) {
+	SOCKET s;
+	duk_size_t count, i;
+	long sent = 0;
+
+	s = duk_require_socket(ctx, 0);
+	if (!duk_is_array(ctx, 1)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "array expected as second argument");
+		return -1;
+	}
+	count = duk_get_length(ctx, 1);
+
+#if defined(_WIN32)
+	{
+		/* the chunks stay reachable through the array while they are sent */
+		WSABUF *bufs = duk_push_fixed_buffer(ctx, (count > 0 ? count : 1) * sizeof(WSABUF));
+		DWORD n = 0;
+
+		for (i = 0; i < count; i++) {
+			duk_size_t sz;
+			duk_get_prop_index(ctx, 1, (duk_uarridx_t) i);
+			bufs[i].buf = (char*) duk_sock_require_data(ctx, -1, &sz);
+			bufs[i].len = (ULONG) sz;
+			duk_pop(ctx);
+		}
+
+		if (WSASend(s, bufs, (DWORD) count, &n, 0, NULL, NULL) == SOCKET_ERROR) {
+			if (!DUK_SOCK_WOULDBLOCK(duk_sock_errno())) {
+				duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not send message (error code %d)", duk_sock_errno());
+				return -1;
+			}
+			n = 0;
+		}
+		sent = (long) n;
+	}
+#else
+	{
+		struct iovec *iov = duk_push_fixed_buffer(ctx, (count > 0 ? count : 1) * sizeof(struct iovec));
+		size_t done = 0;
+
+		for (i = 0; i < count; i++) {
+			duk_size_t sz;
+			duk_get_prop_index(ctx, 1, (duk_uarridx_t) i);
+			iov[i].iov_base = (void*) duk_sock_require_data(ctx, -1, &sz);
+			iov[i].iov_len = sz;
+			duk_pop(ctx);
+		}
+
+		/* sendmsg takes at most IOV_MAX chunks; go on while batches are sent completely */
+		while (done < count) {
+			struct msghdr msg;
+			size_t batch = (count - done > IOV_MAX) ? IOV_MAX : count - done;
+			size_t want = 0, j;
+			ssize_t n;
+
+			for (j = 0; j < batch; j++) {
+				want += iov[done + j].iov_len;
+			}
+
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov + done;
+			msg.msg_iovlen = batch;
+
+			n = sendmsg(s, &msg, DUK_SOCK_SENDFLAGS);
+			if (n < 0) {
+				if (DUK_SOCK_WOULDBLOCK(duk_sock_errno())) {
+					break;
+				}
+				duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not send message (error code %d)", duk_sock_errno());
+				return -1;
+			}
+
+			sent += (long) n;
+			if ((size_t) n < want) {
+				break;
+			}
+			done += batch;
+		}
+	}
+#endif
+
+	duk_push_number(ctx, (duk_double_t) sent);
+	return 1;
 }
 
+/*
+sendFile(s, path|fd, [offset], [length]) : sends (part of) a file without
+copying it through the heap (sendfile on Linux, TransmitFile on Windows).
+Sends until offset + length or the end of the file (stopping early when a
+non-blocking socket is full) and returns the number of bytes sent.
+*/
+
+#if defined(_WIN32)
+typedef HANDLE duk_sock_file;
+#else
+typedef int duk_sock_file;
+#endif
+
+/* chunk size of the read/send fallback */
+#define DUK_SOCK_FILE_CHUNK (64 * 1024)
+
+/* returns the number of bytes sent, or -1 with *what describing the failed call (the error code is in *err) */
+static double duk_sock_sendfile(SOCKET s, duk_sock_file f, double offset, double length, const char **what, int *err) {
+	double size, sent = 0;
+
+#if defined(_WIN32)
+	LARGE_INTEGER pos, fsize;
+
+	if (!GetFileSizeEx(f, &fsize)) {
+		*what = "stat file"; *err = (int) GetLastError();
+		return -1;
+	}
+	size = (double) fsize.QuadPart;
+#else
+	struct stat st;
+
+	if (fstat(f, &st) != 0) {
+		*what = "stat file"; *err = errno;
+		return -1;
+	}
+	size = (double) st.st_size;
+#endif
+
+	if (offset >= size) {
+		return 0;
+	}
+	if (length < 0 || offset + length > size) {
+		length = size - offset;
+	}
+
+	while (sent < length) {
+		/* TransmitFile takes at most 2^31 - 2 bytes, sendfile 2^31 - 4096 */
+		double left = length - sent;
+		size_t want = (left > 0x40000000) ? 0x40000000 : (size_t) left;
+
+#if defined(_WIN32)
+		pos.QuadPart = (LONGLONG) (offset + sent);
+		if (!SetFilePointerEx(f, pos, NULL, FILE_BEGIN)) {
+			*what = "seek file"; *err = (int) GetLastError();
+			return -1;
+		}
+		if (!TransmitFile(s, f, (DWORD) want, 0, NULL, NULL, 0)) {
+			if (DUK_SOCK_WOULDBLOCK(duk_sock_errno())) {
+				break;
+			}
+			*what = "send file"; *err = duk_sock_errno();
+			return -1;
+		}
+		sent += want;
+#else
+		ssize_t n;
+#if defined(__linux__)
+		off_t pos = (off_t) (offset + sent);
+		n = sendfile(s, f, &pos, want);
+#else
+		/* no portable sendfile: copy through a stack buffer, which still keeps the bytes out of the heap */
+		char buff[DUK_SOCK_FILE_CHUNK];
+		ssize_t r = pread(f, buff, want > sizeof(buff) ? sizeof(buff) : want, (off_t) (offset + sent));
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			*what = "read file"; *err = errno;
+			return -1;
+		}
+		n = (r == 0) ? 0 : send(s, buff, (size_t) r, DUK_SOCK_SENDFLAGS);
+#endif
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (DUK_SOCK_WOULDBLOCK(errno)) {
+				break;
+			}
+			*what = "send file"; *err = errno;
+			return -1;
+		}
+		if (n == 0) {
+			break; /* the file shrank */
+		}
+		sent += n;
+#if !defined(__linux__)
+		if (n < r) {
+			break; /* the socket is full, the caller goes on from offset + sent */
+		}
+#endif
+#endif
+	}
+
+	return sent;
+}
+
+static duk_ret_t duk_sendfile(duk_context *ctx) {
+	SOCKET s = duk_require_socket(ctx, 0);
+	double offset = duk_is_number(ctx, 2) ? duk_require_number(ctx, 2) : 0;
+	double length = duk_is_number(ctx, 3) ? duk_require_number(ctx, 3) : -1;
+	const char *path = NULL, *what = NULL;
+	duk_sock_file f;
+	double sent;
+	int err = 0;
+
+	if (!(offset >= 0)) {
+		duk_error(ctx, DUK_ERR_RANGE_ERROR, "offset out of range");
+		return -1;
+	}
+
+	if (duk_is_string(ctx, 1)) {
+		path = duk_get_string(ctx, 1);
+#if defined(_WIN32)
+		f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (f == INVALID_HANDLE_VALUE) {
+			duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not open file '%s' (error code %d)", path, (int) GetLastError());
+			return -1;
+		}
+#else
+		f = open(path, O_RDONLY);
+		if (f < 0) {
+			duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not open file '%s' (error code %d)", path, errno);
+			return -1;
+		}
+#endif
+	} else {
+#if defined(_WIN32)
+		f = (HANDLE) _get_osfhandle(duk_require_int(ctx, 1));
+		if (f == INVALID_HANDLE_VALUE) {
+			duk_error(ctx, DUK_ERR_TYPE_ERROR, "invalid file descriptor");
+			return -1;
+		}
+#else
+		f = duk_require_int(ctx, 1);
+#endif
+	}
+
+	sent = duk_sock_sendfile(s, f, offset, length, &what, &err);
+
+	if (path != NULL) {
+#if defined(_WIN32)
+		CloseHandle(f);
+#else
+		close(f);
+#endif
+	}
+
+	if (sent < 0) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not %s (error code %d)", what, err);
+		return -1;
+	}
+
+	duk_push_number(ctx, sent);
+	return 1;
+}
+
+/* recv(s, [size]) : receives up to size bytes (DUK_SOCK_BUFLEN by default) as a string */
 static duk_ret_t duk_recv(duk_context *ctx) {
 	SOCKET s;
-	char buff[DUK_SOCK_BUFLEN];
+	char stackbuff[DUK_SOCK_BUFLEN];
+	char *buff = stackbuff;
+	duk_size_t size = DUK_SOCK_BUFLEN;
 	int recv_size;
 
-	s = (SOCKET) duk_require_pointer(ctx, 0);
+	s = duk_require_socket(ctx, 0);
+
+	if (duk_is_number(ctx, 1)) {
+		size = (duk_size_t) duk_require_uint(ctx, 1);
+		if (size == 0 || size > INT_MAX) {
+			duk_error(ctx, DUK_ERR_RANGE_ERROR, "invalid receive size");
+		}
+		if (size > DUK_SOCK_BUFLEN) {
+			buff = duk_push_buffer_raw(ctx, size, DUK_BUF_FLAG_NOZERO);
+		}
+	}
 
-	if((recv_size = recv(s, buff, DUK_SOCK_BUFLEN, 0)) == SOCKET_ERROR) {
-		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not receive reply");
+	if((recv_size = recv(s, buff, (int) size, 0)) == SOCKET_ERROR) {
+		if (DUK_SOCK_WOULDBLOCK(duk_sock_errno())) {
+			duk_push_null(ctx);
+			return 1;
+		}
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not receive reply (error code %d)", duk_sock_errno());
         return -1;
 	}
 
@@ -167,16 +578,71 @@ static duk_ret_t duk_recv(duk_context *ctx) {
 	return 1;
 }
 
+/*
+recvInto(s, buffer, [offset], [length]) : receives into an existing buffer,
+returns the number of bytes received (0 when the peer closed the connection,
+null when a non-blocking socket has no data)
+*/
+static duk_ret_t duk_recvinto(duk_context *ctx) {
+	SOCKET s;
+	char *buff;
+	duk_size_t size;
+	int recv_size;
+
+	s = duk_require_socket(ctx, 0);
+	if (duk_is_string(ctx, 1)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "buffer expected");
+	}
+	buff = (char*) duk_sock_require_data(ctx, 1, &size);
+	if (size > INT_MAX) {
+		size = INT_MAX;
+	}
+
+	if ((recv_size = recv(s, buff, (int) size, 0)) == SOCKET_ERROR) {
+		if (DUK_SOCK_WOULDBLOCK(duk_sock_errno())) {
+			duk_push_null(ctx);
+			return 1;
+		}
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not receive reply (error code %d)", duk_sock_errno());
+		return -1;
+	}
+
+	duk_push_int(ctx, recv_size);
+	return 1;
+}
+
+/* setblocking(s, blocking) : switches between blocking and non-blocking mode */
+static duk_ret_t duk_setblocking(duk_context *ctx) {
+	SOCKET s = duk_require_socket(ctx, 0);
+	int blocking = duk_require_boolean(ctx, 1);
+	int res;
+
+#if defined(_WIN32)
+	u_long mode = blocking ? 0 : 1;
+	res = ioctlsocket(s, FIONBIO, &mode);
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	res = (flags < 0) ? -1 : fcntl(s, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+#endif
+
+	if (res != 0) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not set blocking mode (error code %d)", duk_sock_errno());
+		return -1;
+	}
+
+	return 0;
+}
+
 static duk_ret_t duk_closesocket(duk_context *ctx) {
 	SOCKET s;
-	s = (SOCKET) duk_require_pointer(ctx, 0);
+	s = duk_require_socket(ctx, 0);
 
 	closesocket(s);
 
 	return 0;
 }
 
-static duk_ret_t duk_get_addrinfo(duk_context *ctx, struct addrinfo *hints, duk_idx_t idx) {
+static void duk_get_addrinfo(duk_context *ctx, struct addrinfo *hints, duk_idx_t idx) {
 	int flags = 0, family = AF_UNSPEC, socktype = SOCK_STREAM, protocol = IPPROTO_TCP;
 
 	if (duk_is_object(ctx, idx)) {
@@ -274,11 +740,11 @@ static duk_ret_t duk_bind(duk_context *ctx) {
 	SOCKET s;
 	struct sockaddr_in server;
 
-	s = (SOCKET) duk_require_pointer(ctx, 0);
+	s = duk_require_socket(ctx, 0);
 	duk_get_sockaddr(ctx, &server);
 
 	if( bind(s, (struct sockaddr *)&server, sizeof(server)) == SOCKET_ERROR) {
-		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not bind socket (error code %d)", WSAGetLastError());
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not bind socket (error code %d)", duk_sock_errno());
         return -1;
 	}
 
@@ -289,12 +755,12 @@ static duk_ret_t duk_listen(duk_context *ctx) {
 	SOCKET s;
 	int backlog, retcode;
 
-	s = (SOCKET) duk_require_pointer(ctx, 0);
+	s = duk_require_socket(ctx, 0);
 	backlog = duk_require_int(ctx, 1);
 
 	retcode = listen(s, backlog);
 	if (retcode != 0) {
-		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not listen on socket (error code %d)", WSAGetLastError());
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not listen on socket (error code %d)", duk_sock_errno());
         return -1;
 	}
 
@@ -304,14 +770,18 @@ static duk_ret_t duk_listen(duk_context *ctx) {
 static duk_ret_t duk_accept(duk_context *ctx) {
 	SOCKET s, new_socket;
 	struct sockaddr_in client;
-	int c;
+	socklen_t c;
 
-	s = (SOCKET) duk_require_pointer(ctx, 0);
+	s = duk_require_socket(ctx, 0);
 
 	c = sizeof(struct sockaddr_in);
 	new_socket = accept(s , (struct sockaddr *)&client, &c);
     if (new_socket == INVALID_SOCKET) {
-    	duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not accept client socket (error code %d)", WSAGetLastError());
+    	if (DUK_SOCK_WOULDBLOCK(duk_sock_errno())) {
+    		duk_push_null(ctx);
+    		return 1;
+    	}
+    	duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not accept client socket (error code %d)", duk_sock_errno());
         return -1;
     }
 
@@ -319,33 +789,330 @@ static duk_ret_t duk_accept(duk_context *ctx) {
     	duk_put_sockaddr(ctx, 1, &client);
     }
 
-    duk_push_pointer(ctx, (void*) new_socket);
+    duk_push_socket(ctx, new_socket);
+	return 1;
+}
+
+// ----------------------------------------------------------------------------
+
+/* push [ { socket, events }, ... ] for the entries of fds with events */
+static void duk_push_ready(duk_context *ctx, duk_pollfd *fds, int count) {
+	duk_idx_t array_idx = duk_push_array(ctx);
+	duk_uarridx_t n = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (fds[i].revents == 0) {
+			continue;
+		}
+
+		duk_push_object(ctx);
+		duk_push_socket(ctx, fds[i].fd);
+		duk_put_prop_string(ctx, -2, "socket");
+		duk_push_int(ctx, fds[i].revents);
+		duk_put_prop_string(ctx, -2, "events");
+		duk_put_prop_index(ctx, array_idx, n++);
+	}
+}
+
+/* get the socket and events of a poll entry: a socket (POLLIN) or { socket, events } */
+static SOCKET duk_get_poll_entry(duk_context *ctx, duk_idx_t idx, short *events) {
+	SOCKET s;
+
+	if (duk_is_pointer(ctx, idx)) {
+		*events = POLLIN;
+		return duk_require_socket(ctx, idx);
+	}
+
+	duk_get_prop_string(ctx, idx, "socket");
+	s = duk_require_socket(ctx, -1);
+	duk_pop(ctx);
+
+	duk_get_prop_string(ctx, idx, "events");
+	*events = duk_is_number(ctx, -1) ? (short) duk_get_int(ctx, -1) : POLLIN;
+	duk_pop(ctx);
+
+	return s;
+}
+
+/* poll(fds, timeout) : waits up to timeout ms (forever if negative or missing), returns the ready entries */
+static duk_ret_t duk_poll(duk_context *ctx) {
+	duk_size_t count, i;
+	int timeout, res;
+	duk_pollfd *fds;
+
+	if (!duk_is_array(ctx, 0)) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "array expected as first argument");
+		return -1;
+	}
+	count = duk_get_length(ctx, 0);
+	timeout = duk_is_number(ctx, 1) ? duk_get_int(ctx, 1) : -1;
+
+	fds = duk_push_fixed_buffer(ctx, (count > 0 ? count : 1) * sizeof(duk_pollfd));
+	for (i = 0; i < count; i++) {
+		duk_get_prop_index(ctx, 0, (duk_uarridx_t) i);
+		fds[i].fd = duk_get_poll_entry(ctx, -1, &fds[i].events);
+		fds[i].revents = 0;
+		duk_pop(ctx);
+	}
+
+	res = duk_sock_poll(fds, (unsigned long) count, timeout);
+	if (res < 0) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not poll sockets (error code %d)", duk_sock_errno());
+		return -1;
+	}
+
+	duk_push_ready(ctx, fds, (int) count);
+	return 1;
+}
+
+/*
+Poller objects keep a set of sockets between waits. On Linux they are an
+epoll instance; elsewhere they keep an array for poll/WSAPoll.
+*/
+
+typedef struct {
+#if defined(DUK_SOCK_USE_EPOLL)
+	int epfd;
+#else
+	duk_pollfd *fds;
+	int count, cap;
+#endif
+} duk_sock_poller;
+
+static duk_sock_poller *duk_poller_from_this(duk_context *ctx) {
+	duk_sock_poller *p;
+
+	duk_push_this(ctx);
+	duk_get_prop_string(ctx, -1, "$data");
+	p = duk_get_pointer(ctx, -1);
+	duk_pop_2(ctx);
+
+	if (p == NULL) {
+		duk_error(ctx, DUK_ERR_TYPE_ERROR, "poller expected");
+	}
+	return p;
+}
+
+static duk_ret_t duk_poller_finalizer(duk_context *ctx) {
+	duk_sock_poller *p;
+
+	duk_get_prop_string(ctx, 0, "$data");
+	p = duk_get_pointer(ctx, -1);
+	if (p == NULL) {
+		return 0;
+	}
+
+#if defined(DUK_SOCK_USE_EPOLL)
+	close(p->epfd);
+#else
+	free(p->fds);
+#endif
+	free(p);
+	return 0;
+}
+
+/* poller() : creates an empty poller */
+static duk_ret_t duk_poller(duk_context *ctx) {
+	duk_sock_poller *p = calloc(1, sizeof(duk_sock_poller));
+	if (p == NULL) {
+		duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not allocate poller");
+		return -1;
+	}
+
+#if defined(DUK_SOCK_USE_EPOLL)
+	p->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (p->epfd < 0) {
+		free(p);
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not create poller (error code %d)", duk_sock_errno());
+		return -1;
+	}
+#endif
+
+	duk_push_object(ctx);
+	duk_push_heap_stash(ctx);
+	duk_get_prop_string(ctx, -1, DUK_SOCK_POLLER_PROTO);
+	duk_set_prototype(ctx, -3);
+	duk_pop(ctx);
+
+	duk_push_pointer(ctx, p);
+	duk_put_prop_string(ctx, -2, "$data");
 	return 1;
 }
 
+#if !defined(DUK_SOCK_USE_EPOLL)
+static int duk_poller_find(duk_sock_poller *p, SOCKET s) {
+	int i;
+	for (i = 0; i < p->count; i++) {
+		if (p->fds[i].fd == s) {
+			return i;
+		}
+	}
+	return -1;
+}
+#endif
+
+#if defined(DUK_SOCK_USE_EPOLL)
+#define DUK_POLLER_ADD EPOLL_CTL_ADD
+#define DUK_POLLER_MODIFY EPOLL_CTL_MOD
+#define DUK_POLLER_REMOVE EPOLL_CTL_DEL
+#else
+#define DUK_POLLER_ADD 0
+#define DUK_POLLER_MODIFY 1
+#define DUK_POLLER_REMOVE 2
+#endif
+
+/* poller.add(s, events), poller.modify(s, events), poller.remove(s) */
+static duk_ret_t duk_poller_control(duk_context *ctx, int op) {
+	duk_sock_poller *p = duk_poller_from_this(ctx);
+	SOCKET s = duk_require_socket(ctx, 0);
+	short events = duk_is_number(ctx, 1) ? (short) duk_get_int(ctx, 1) : POLLIN;
+	int res;
+
+#if defined(DUK_SOCK_USE_EPOLL)
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = (uint32_t) (unsigned short) events;
+	ev.data.fd = s;
+	res = epoll_ctl(p->epfd, op, s, &ev);
+#else
+	int i = duk_poller_find(p, s);
+
+	if ((op == DUK_POLLER_ADD) != (i < 0)) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not update poller (socket %s)", (i < 0) ? "not added" : "already added");
+		return -1;
+	}
+
+	if (op == DUK_POLLER_ADD) {
+		if (p->count == p->cap) {
+			int cap = p->cap ? p->cap * 2 : 16;
+			duk_pollfd *fds = realloc(p->fds, cap * sizeof(duk_pollfd));
+			if (fds == NULL) {
+				duk_error(ctx, DUK_ERR_ALLOC_ERROR, "could not grow poller");
+				return -1;
+			}
+			p->fds = fds;
+			p->cap = cap;
+		}
+		i = p->count++;
+		p->fds[i].fd = s;
+	}
+
+	if (op == DUK_POLLER_REMOVE) {
+		p->fds[i] = p->fds[--p->count];
+	} else {
+		p->fds[i].events = events;
+		p->fds[i].revents = 0;
+	}
+	res = 0;
+#endif
+
+	if (res != 0) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not update poller (error code %d)", duk_sock_errno());
+		return -1;
+	}
+	return 0;
+}
+
+static duk_ret_t duk_poller_add(duk_context *ctx) {
+	return duk_poller_control(ctx, DUK_POLLER_ADD);
+}
+
+static duk_ret_t duk_poller_modify(duk_context *ctx) {
+	return duk_poller_control(ctx, DUK_POLLER_MODIFY);
+}
+
+static duk_ret_t duk_poller_remove(duk_context *ctx) {
+	return duk_poller_control(ctx, DUK_POLLER_REMOVE);
+}
+
+/* poller.wait([timeout], [max]) : waits up to timeout ms (forever by default), returns [ { socket, events }, ... ] */
+static duk_ret_t duk_poller_wait(duk_context *ctx) {
+	duk_sock_poller *p = duk_poller_from_this(ctx);
+	int timeout = duk_is_number(ctx, 0) ? duk_get_int(ctx, 0) : -1;
+	int res;
+
+#if defined(DUK_SOCK_USE_EPOLL)
+	int max = duk_is_number(ctx, 1) ? duk_get_int(ctx, 1) : 256;
+	struct epoll_event *events;
+	duk_idx_t array_idx;
+	int i;
+
+	if (max <= 0) {
+		max = 256;
+	}
+	events = duk_push_fixed_buffer(ctx, max * sizeof(struct epoll_event));
+
+	do {
+		res = epoll_wait(p->epfd, events, max, timeout);
+	} while (res < 0 && errno == EINTR);
+	if (res < 0) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not wait on poller (error code %d)", duk_sock_errno());
+		return -1;
+	}
+
+	array_idx = duk_push_array(ctx);
+	for (i = 0; i < res; i++) {
+		duk_push_object(ctx);
+		duk_push_socket(ctx, events[i].data.fd);
+		duk_put_prop_string(ctx, -2, "socket");
+		duk_push_int(ctx, (duk_int_t) events[i].events);
+		duk_put_prop_string(ctx, -2, "events");
+		duk_put_prop_index(ctx, array_idx, i);
+	}
+#else
+	res = duk_sock_poll(p->fds, p->count, timeout);
+	if (res < 0) {
+		duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "could not wait on poller (error code %d)", duk_sock_errno());
+		return -1;
+	}
+	duk_push_ready(ctx, p->fds, p->count);
+#endif
+
+	return 1;
+}
+
+static const duk_function_list_entry poller_methods[] = {
+	{ "add", duk_poller_add, 2 },
+	{ "modify", duk_poller_modify, 2 },
+	{ "remove", duk_poller_remove, 1 },
+	{ "wait", duk_poller_wait, 2 },
+	{ NULL, NULL, 0 }
+};
+
 const duk_function_list_entry sock_functions [] = {
     { "socket", duk_socket, 3 },
     { "connect", duk_connect, 4 },
     { "inet_addr", duk_inetaddr, 1 },
-    { "send", duk_send, 2 },
-    { "recv", duk_recv, 1 },
+    { "send", duk_send, 4 },
+    { "recv", duk_recv, 2 },
+    { "recvInto", duk_recvinto, 4 },
+    { "writev", duk_writev, 2 },
+    { "sendFile", duk_sendfile, 4 },
     { "closesocket", duk_closesocket, 1 },
     { "getaddrinfo", duk_getaddrinfo, 3 },
     { "bind", duk_bind, 4 },
     { "listen", duk_listen, 2 },
     { "accept", duk_accept, 2 },
+    { "setblocking", duk_setblocking, 2 },
+    { "poll", duk_poll, 2 },
+    { "poller", duk_poller, 0 },
     { NULL, NULL, 0 }
 };
 
 // ----------------------------------------------------------------------------
 
+#if defined(_WIN32)
 static duk_ret_t sock_finalizer(duk_context *ctx) {
 	WSACleanup();
 
 	return 0;
 }
+#endif
 
 static void sock_core(duk_context *ctx, duk_idx_t idx) {
+#if defined(_WIN32)
 	WSADATA wsa; /* will we need this? */
 
 #ifdef DEBUG
@@ -363,6 +1130,16 @@ static void sock_core(duk_context *ctx, duk_idx_t idx) {
     duk_set_finalizer(ctx, -2);
     duk_put_prop_string(ctx, -2, "armornick_sock_wsa");
     duk_pop(ctx);
+#endif
+
+    /* poller prototype */
+    duk_push_heap_stash(ctx);
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, poller_methods);
+    duk_push_c_function(ctx, duk_poller_finalizer, 1);
+    duk_set_finalizer(ctx, -2);
+    duk_put_prop_string(ctx, -2, DUK_SOCK_POLLER_PROTO);
+    duk_pop(ctx);
 
 #ifdef DEBUG
     printf("registering Winsock2 functions\n");
@@ -381,18 +1158,33 @@ static void sock_core(duk_context *ctx, duk_idx_t idx) {
     /* register address families */
     REGISTER_CONST(ctx, idx, AF_UNSPEC);
     REGISTER_CONST(ctx, idx, AF_INET);
+    REGISTER_CONST(ctx, idx, AF_INET6);
+#ifdef AF_IPX
     REGISTER_CONST(ctx, idx, AF_IPX);
+#endif
+#ifdef AF_APPLETALK
     REGISTER_CONST(ctx, idx, AF_APPLETALK);
+#endif
+#ifdef AF_NETBIOS
     REGISTER_CONST(ctx, idx, AF_NETBIOS);
-    REGISTER_CONST(ctx, idx, AF_INET6);
+#endif
+#ifdef AF_IRDA
     REGISTER_CONST(ctx, idx, AF_IRDA);
+#endif
+#ifdef AF_BTH
     REGISTER_CONST(ctx, idx, AF_BTH);
+#endif
+#ifdef AF_UNIX
+    REGISTER_CONST(ctx, idx, AF_UNIX);
+#endif
 
     /* register socket type specifications */
     REGISTER_CONST(ctx, idx, SOCK_STREAM);
     REGISTER_CONST(ctx, idx, SOCK_DGRAM);
     REGISTER_CONST(ctx, idx, SOCK_RAW);
+#ifdef SOCK_RDM
     REGISTER_CONST(ctx, idx, SOCK_RDM);
+#endif
     REGISTER_CONST(ctx, idx, SOCK_SEQPACKET);
 
     /* register socket protocols */
@@ -414,11 +1206,23 @@ static void sock_core(duk_context *ctx, duk_idx_t idx) {
     REGISTER_CONST(ctx, idx, AI_NUMERICHOST);
     REGISTER_CONST(ctx, idx, AI_ALL);
     REGISTER_CONST(ctx, idx, AI_V4MAPPED);
+#ifdef AI_NON_AUTHORITATIVE
     REGISTER_CONST(ctx, idx, AI_NON_AUTHORITATIVE);
+#endif
+#ifdef AI_SECURE
     REGISTER_CONST(ctx, idx, AI_SECURE);
+#endif
+#ifdef AI_RETURN_PREFERRED_NAMES
     REGISTER_CONST(ctx, idx, AI_RETURN_PREFERRED_NAMES);
+#endif
     // REGISTER_CONST(ctx, idx, AI_FQDN);
     // REGISTER_CONST(ctx, idx, AI_FILESERVER);
+
+    /* poll events */
+    REGISTER_CONST(ctx, idx, POLLIN);
+    REGISTER_CONST(ctx, idx, POLLOUT);
+    REGISTER_CONST(ctx, idx, POLLERR);
+    REGISTER_CONST(ctx, idx, POLLHUP);
 }
 
 // ----------------------------------------------------------------------------
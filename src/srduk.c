@@ -17,9 +17,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#endif
 
 #include "glue.h"
 #include "duktape.h"
+#include "zlib.h"
+#include "dukalloc/dukalloc.h"
 
 #ifdef _WIN32
 #define alert(progname,message)	MessageBox(NULL,message,progname,MB_ICONERROR | MB_OK)
@@ -44,30 +52,404 @@ static void srduk_push_argv (duk_context *ctx, int argc, char *argv[]) {
 
 #define cannot(x) duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"cannot %s %s: %s",x,srduk_filename,strerror(errno))
 
-static void srduk_load_script (duk_context *ctx, char *srduk_filename) {
+/*
+Payload types (the last character of the glue signature, see glue.h):
+  L  JavaScript source
+  B  bytecode from duk_dump_function (see srduk_compile)
+  Z  bytecode compressed with zlib, preceded by its size as 4 bytes (little endian)
+  A  bundle of modules (see srduk_bundle_register)
+*/
+#define SRDUK_SOURCE 'L'
+#define SRDUK_BYTECODE 'B'
+#define SRDUK_ZBYTECODE 'Z'
+#define SRDUK_BUNDLE 'A'
+
+static void srduk_bundle_register (duk_context *ctx, char *srduk_filename);
+
+/* push the bytecode in the compressed buffer at the top of the stack (replaced) */
+static void srduk_inflate (duk_context *ctx, char *srduk_filename) {
+	duk_size_t zlen; uLongf len;
+	unsigned char *z = duk_require_buffer(ctx, -1, &zlen);
+	void *bytecode;
+
+	if (zlen < 4) duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"invalid Duktape program in %s",srduk_filename);
+	len = (uLongf) z[0] | ((uLongf) z[1] << 8) | ((uLongf) z[2] << 16) | ((uLongf) z[3] << 24);
+
+	bytecode = duk_push_buffer_raw(ctx, len, DUK_BUF_FLAG_NOZERO);
+	if (uncompress(bytecode, &len, z + 4, (uLong) (zlen - 4)) != Z_OK)
+		duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"invalid Duktape program in %s",srduk_filename);
+
+	duk_remove(ctx, -2);
+}
+
+/* run the program glued to the executable, returns 0 if there is none */
+static int srduk_load_script (duk_context *ctx, char *srduk_filename) {
 	Glue t;
+	void *payload;
+	char type;
 	FILE *f=fopen(srduk_filename,"rb");
 
 	if (f==NULL) cannot("open");
 	if (fseek(f,-sizeof(t),SEEK_END)!=0) cannot("seek");
 	if (fread(&t,sizeof(t),1,f)!=1) cannot("read");
-	if (memcmp(t.sig,GLUESIG,GLUELEN)!=0) duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"no Duktape program found in %s",srduk_filename);
+	if (memcmp(t.sig,GLUESIG,GLUETYP)!=0) { fclose(f); return 0; }
 	if (fseek(f,t.size1,SEEK_SET)!=0) cannot("seek");
 
-#if defined(__GNUC__) && !defined(DUK_NO_VLA)
-	char filebuff[t.size2]; 
+	type = t.sig[GLUETYP];
+	if (type!=SRDUK_SOURCE && type!=SRDUK_BYTECODE && type!=SRDUK_ZBYTECODE && type!=SRDUK_BUNDLE)
+		duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"unknown Duktape program type '%c' in %s",type,srduk_filename);
+
+	payload = duk_push_buffer_raw(ctx, t.size2, DUK_BUF_FLAG_NOZERO);
+	if (fread(payload,1,t.size2,f)!=(size_t)t.size2) cannot("read");
+	fclose(f);
+
+	if (type==SRDUK_SOURCE) {
+		duk_eval_lstring_noresult(ctx, payload, t.size2);
+		duk_pop(ctx);
+		return 1;
+	}
+
+	if (type==SRDUK_BUNDLE) {
+		srduk_bundle_register(ctx, srduk_filename);
+		duk_eval_string_noresult(ctx, "require('main')");
+		return 1;
+	}
+
+	/* bytecode skips the compiler entirely */
+	if (type==SRDUK_ZBYTECODE) srduk_inflate(ctx, srduk_filename);
+	duk_load_function(ctx);
+	duk_call(ctx, 0);
+	duk_pop(ctx);
+	return 1;
+}
+
+/* push the contents of a file as a buffer */
+static void *srduk_push_file (duk_context *ctx, const char *filename, duk_size_t *out_len) {
+	FILE *f;
+	void *data;
+	long len;
+
+	f=fopen(filename,"rb");
+	if (f==NULL || fseek(f,0,SEEK_END)!=0 || (len=ftell(f))<0 || fseek(f,0,SEEK_SET)!=0)
+		duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"cannot read %s: %s",filename,strerror(errno));
+	data = duk_push_buffer_raw(ctx, len, DUK_BUF_FLAG_NOZERO);
+	if (fread(data,1,len,f)!=(size_t)len)
+		duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"cannot read %s: %s",filename,strerror(errno));
+	fclose(f);
+
+	*out_len = (duk_size_t) len;
+	return data;
+}
+
+/* write a buffer to a file */
+static void srduk_write_file (duk_context *ctx, const char *filename, const void *data, duk_size_t len) {
+	FILE *f=fopen(filename,"wb");
+	if (f==NULL || fwrite(data,1,len,f)!=len || fclose(f)!=0)
+		duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"cannot write %s: %s",filename,strerror(errno));
+}
+
+/* srduk -c prog.js prog.bc [-z] : compiles prog.js to bytecode for glue (type B, or Z with -z) */
+static void srduk_compile (duk_context *ctx, const char *srcname, const char *outname, int compressed) {
+	void *data; duk_size_t len, srclen;
+
+	data = srduk_push_file(ctx, srcname, &srclen);
+
+	duk_push_string(ctx, srcname);
+	duk_compile_lstring_filename(ctx, 0, data, srclen);
+	duk_dump_function(ctx);
+	data = duk_get_buffer(ctx, -1, &len);
+
+	if (compressed) {
+		uLongf zlen = compressBound((uLong) len);
+		unsigned char *z = duk_push_buffer_raw(ctx, zlen + 4, DUK_BUF_FLAG_NOZERO);
+
+		z[0] = (unsigned char) (len & 0xff);
+		z[1] = (unsigned char) ((len >> 8) & 0xff);
+		z[2] = (unsigned char) ((len >> 16) & 0xff);
+		z[3] = (unsigned char) ((len >> 24) & 0xff);
+		if (compress2(z + 4, &zlen, data, (uLong) len, Z_BEST_COMPRESSION) != Z_OK)
+			duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"cannot compress %s",srcname);
+
+		data = z;
+		len = zlen + 4;
+	}
+
+	srduk_write_file(ctx, outname, data, len);
+}
+
+/*
+------------------------------------------------------------------------------------
+Bundles (payload type A)
+
+A directory of modules with a hash index, served by Duktape.modSearch
+straight from memory. The program starts by requiring the module 'main'.
+Layout (numbers are 4 byte little endian, offsets are from the start):
+
+  header   "DUKA" count slots 0
+  entries  count x { hash, name offset, name length, data offset, data length, flags }
+  index    slots x (entry number + 1), 0 for empty slots, linear probing
+  names and module data
+------------------------------------------------------------------------------------
+*/
+
+#define SRDUK_BUNDLE_MAGIC "DUKA"
+#define SRDUK_BUNDLE_HEADER 16
+#define SRDUK_BUNDLE_ENTRY 24
+#define SRDUK_BUNDLE_BYTECODE 1 /* data is a dumped module wrapper function, otherwise source */
+#define SRDUK_BUNDLE_STASH "srduk_bundle"
+
+static duk_uint32_t srduk_get32 (const unsigned char *p) {
+	return (duk_uint32_t) p[0] | ((duk_uint32_t) p[1] << 8) | ((duk_uint32_t) p[2] << 16) | ((duk_uint32_t) p[3] << 24);
+}
+
+static void srduk_put32 (unsigned char *p, duk_uint32_t v) {
+	p[0] = (unsigned char) (v & 0xff);
+	p[1] = (unsigned char) ((v >> 8) & 0xff);
+	p[2] = (unsigned char) ((v >> 16) & 0xff);
+	p[3] = (unsigned char) ((v >> 24) & 0xff);
+}
+
+/* FNV-1a */
+static duk_uint32_t srduk_hash (const char *s, duk_size_t len) {
+	duk_uint32_t h = 2166136261u;
+	while (len-- > 0) {
+		h ^= (unsigned char) *s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* Duktape.modSearch(id, require, exports, module) for bundled modules */
+static duk_ret_t srduk_bundle_modsearch (duk_context *ctx) {
+	const unsigned char *b, *e;
+	const char *id; duk_size_t idlen, size;
+	duk_uint32_t h, slots, i, n;
+
+	id = duk_require_lstring(ctx, 0, &idlen);
+
+	/* the stash keeps the bundle alive */
+	duk_push_heap_stash(ctx);
+	duk_get_prop_string(ctx, -1, SRDUK_BUNDLE_STASH);
+	b = duk_require_buffer(ctx, -1, &size);
+	duk_pop_2(ctx);
+
+	slots = srduk_get32(b + 8);
+	h = srduk_hash(id, idlen);
+
+	for (i = h & (slots - 1); (n = srduk_get32(b + SRDUK_BUNDLE_HEADER + srduk_get32(b + 4) * SRDUK_BUNDLE_ENTRY + i * 4)) != 0; i = (i + 1) & (slots - 1)) {
+		e = b + SRDUK_BUNDLE_HEADER + (n - 1) * SRDUK_BUNDLE_ENTRY;
+		if (srduk_get32(e) != h || srduk_get32(e + 8) != idlen || memcmp(b + srduk_get32(e + 4), id, idlen) != 0) continue;
+
+		if (!(srduk_get32(e + 20) & SRDUK_BUNDLE_BYTECODE)) {
+			duk_push_lstring(ctx, (const char *) b + srduk_get32(e + 12), srduk_get32(e + 16));
+			return 1;
+		}
+
+		duk_push_external_buffer(ctx);
+		duk_config_buffer(ctx, -1, (void *) (b + srduk_get32(e + 12)), srduk_get32(e + 16));
+		duk_load_function(ctx);
+
+		/* mod_func.call(exports, require, exports, module), like Duktape's require() */
+		duk_dup(ctx, 2);
+		duk_dup(ctx, 1);
+		duk_dup(ctx, 2);
+		duk_dup(ctx, 3);
+		duk_call_method(ctx, 3);
+		return 0;
+	}
+
+	duk_error(ctx, DUK_ERR_ERROR, "module not found: %s", id);
+	return 0;
+}
+
+/* check the bundle at the top of the stack, move it to the stash and install the modSearch function */
+static void srduk_bundle_register (duk_context *ctx, char *srduk_filename) {
+	const unsigned char *b, *e;
+	duk_size_t size;
+	duk_uint32_t count, slots, i;
+
+	b = duk_require_buffer(ctx, -1, &size);
+	if (size < SRDUK_BUNDLE_HEADER || memcmp(b, SRDUK_BUNDLE_MAGIC, 4) != 0) goto invalid;
+
+	count = srduk_get32(b + 4);
+	slots = srduk_get32(b + 8);
+	if (slots == 0 || (slots & (slots - 1)) != 0 || count >= slots) goto invalid;
+	if ((size - SRDUK_BUNDLE_HEADER) / SRDUK_BUNDLE_ENTRY < count) goto invalid;
+	if ((size - SRDUK_BUNDLE_HEADER - count * SRDUK_BUNDLE_ENTRY) / 4 < slots) goto invalid;
+
+	for (i = 0; i < count; i++) {
+		e = b + SRDUK_BUNDLE_HEADER + i * SRDUK_BUNDLE_ENTRY;
+		if (srduk_get32(e + 4) > size || srduk_get32(e + 8) > size - srduk_get32(e + 4)) goto invalid;
+		if (srduk_get32(e + 12) > size || srduk_get32(e + 16) > size - srduk_get32(e + 12)) goto invalid;
+	}
+	for (i = 0; i < slots; i++) {
+		if (srduk_get32(b + SRDUK_BUNDLE_HEADER + count * SRDUK_BUNDLE_ENTRY + i * 4) > count) goto invalid;
+	}
+
+	duk_push_heap_stash(ctx);
+	duk_dup(ctx, -2);
+	duk_put_prop_string(ctx, -2, SRDUK_BUNDLE_STASH);
+	duk_pop_2(ctx);
+
+	duk_get_global_string(ctx, "Duktape");
+	duk_push_c_function(ctx, srduk_bundle_modsearch, 4);
+	duk_put_prop_string(ctx, -2, "modSearch");
+	duk_pop(ctx);
+	return;
+
+invalid:
+	duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"invalid Duktape bundle in %s",srduk_filename);
+}
+
+/* add a module as [ id, data, flags ] to the array at list_idx */
+static void srduk_bundle_add (duk_context *ctx, duk_idx_t list_idx, const char *filename, const char *id, int sources) {
+	void *data; duk_size_t len;
+	int flags = 0;
+
+	duk_push_array(ctx);
+	duk_push_string(ctx, id);
+	duk_put_prop_index(ctx, -2, 0);
+
+	data = srduk_push_file(ctx, filename, &len);
+	if (!sources) {
+		/* same wrapper and fileName as Duktape's require() */
+		duk_push_string(ctx, "(function(require,exports,module){");
+		duk_push_lstring(ctx, (const char *) data, len);
+		duk_push_string(ctx, "})");
+		duk_concat(ctx, 3);
+		duk_push_string(ctx, id);
+		duk_eval_raw(ctx, NULL, 0, DUK_COMPILE_EVAL);
+		duk_dump_function(ctx);
+		duk_remove(ctx, -2);
+		flags = SRDUK_BUNDLE_BYTECODE;
+	}
+	duk_put_prop_index(ctx, -2, 1);
+
+	duk_push_int(ctx, flags);
+	duk_put_prop_index(ctx, -2, 2);
+
+	duk_put_prop_index(ctx, list_idx, (duk_uarridx_t) duk_get_length(ctx, list_idx));
+}
+
+static int srduk_is_module (const char *name) {
+	size_t len = strlen(name);
+	return len > 3 && strcmp(name + len - 3, ".js") == 0;
+}
+
+/* add the .js files below dir, with ids relative to the bundle root (prefix) */
+static void srduk_bundle_walk (duk_context *ctx, duk_idx_t list_idx, const char *dir, const char *prefix, int sources) {
+#ifdef _WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE h;
+
+	duk_push_sprintf(ctx, "%s/*", dir);
+	h = FindFirstFileA(duk_get_string(ctx, -1), &fd);
+	duk_pop(ctx);
+	if (h == INVALID_HANDLE_VALUE) duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"cannot open directory %s",dir);
+
+	do {
+		const char *name = fd.cFileName;
+		int is_dir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
 #else
-	char *filebuff = malloc(t.size2);
+	DIR *d;
+	struct dirent *ent;
+	struct stat st;
+
+	d = opendir(dir);
+	if (d == NULL) duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"cannot open directory %s: %s",dir,strerror(errno));
+
+	while ((ent = readdir(d)) != NULL) {
+		const char *name = ent->d_name;
+		int is_dir;
 #endif
-	int n;
-	if (filebuff == NULL) duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"could not allocate memory to hold file");
-	n = fread(filebuff,1,t.size2,f);
-	duk_eval_lstring_noresult(ctx, filebuff, n);
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
 
-#if !defined(__GNUC__) || defined(DUK_NO_VLA)
-	free(filebuff);
+		duk_push_sprintf(ctx, "%s/%s", dir, name);
+#ifndef _WIN32
+		if (stat(duk_get_string(ctx, -1), &st) != 0) { duk_pop(ctx); continue; }
+		is_dir = S_ISDIR(st.st_mode);
 #endif
-	fclose(f);
+		if (is_dir) {
+			duk_push_sprintf(ctx, "%s%s/", prefix, name);
+			srduk_bundle_walk(ctx, list_idx, duk_get_string(ctx, -2), duk_get_string(ctx, -1), sources);
+			duk_pop(ctx);
+		} else if (srduk_is_module(name)) {
+			duk_push_sprintf(ctx, "%s%.*s", prefix, (int) (strlen(name) - 3), name);
+			srduk_bundle_add(ctx, list_idx, duk_get_string(ctx, -2), duk_get_string(ctx, -1), sources);
+			duk_pop(ctx);
+		}
+		duk_pop(ctx);
+#ifdef _WIN32
+	} while (FindNextFileA(h, &fd));
+	FindClose(h);
+#else
+	}
+	closedir(d);
+#endif
+}
+
+/* srduk -a dir prog.bundle [-s] : packs the modules in dir for glue (type A), as bytecode unless -s is given */
+static void srduk_bundle (duk_context *ctx, const char *dir, const char *outname, int sources) {
+	duk_idx_t list_idx;
+	duk_uint32_t count, slots, i, pos, h;
+	duk_size_t total, len;
+	unsigned char *b;
+	const char *id; void *data;
+
+	list_idx = duk_push_array(ctx);
+	srduk_bundle_walk(ctx, list_idx, dir, "", sources);
+
+	count = (duk_uint32_t) duk_get_length(ctx, list_idx);
+	for (slots = 4; slots < count * 2; slots *= 2);
+
+	total = SRDUK_BUNDLE_HEADER + count * SRDUK_BUNDLE_ENTRY + slots * 4;
+	for (i = 0; i < count; i++) {
+		duk_get_prop_index(ctx, list_idx, i);
+		duk_get_prop_index(ctx, -1, 0);
+		duk_get_lstring(ctx, -1, &len);
+		total += len;
+		duk_get_prop_index(ctx, -2, 1);
+		duk_get_buffer(ctx, -1, &len);
+		total += len;
+		duk_pop_3(ctx);
+	}
+
+	b = duk_push_fixed_buffer(ctx, total);  /* zeroed: empty slots */
+	memcpy(b, SRDUK_BUNDLE_MAGIC, 4);
+	srduk_put32(b + 4, count);
+	srduk_put32(b + 8, slots);
+
+	pos = SRDUK_BUNDLE_HEADER + count * SRDUK_BUNDLE_ENTRY + slots * 4;
+	for (i = 0; i < count; i++) {
+		unsigned char *e = b + SRDUK_BUNDLE_HEADER + i * SRDUK_BUNDLE_ENTRY;
+		duk_uint32_t slot;
+
+		duk_get_prop_index(ctx, list_idx, i);
+		duk_get_prop_index(ctx, -1, 0);
+		id = duk_get_lstring(ctx, -1, &len);
+		h = srduk_hash(id, len);
+		srduk_put32(e, h);
+		srduk_put32(e + 4, pos);
+		srduk_put32(e + 8, (duk_uint32_t) len);
+		memcpy(b + pos, id, len);
+		pos += (duk_uint32_t) len;
+
+		duk_get_prop_index(ctx, -2, 1);
+		data = duk_get_buffer(ctx, -1, &len);
+		srduk_put32(e + 12, pos);
+		srduk_put32(e + 16, (duk_uint32_t) len);
+		memcpy(b + pos, data, len);
+		pos += (duk_uint32_t) len;
+
+		duk_get_prop_index(ctx, -3, 2);
+		srduk_put32(e + 20, (duk_uint32_t) duk_get_int(ctx, -1));
+		duk_pop_n(ctx, 4);
+
+		for (slot = h & (slots - 1); srduk_get32(b + SRDUK_BUNDLE_HEADER + count * SRDUK_BUNDLE_ENTRY + slot * 4) != 0; slot = (slot + 1) & (slots - 1));
+		srduk_put32(b + SRDUK_BUNDLE_HEADER + count * SRDUK_BUNDLE_ENTRY + slot * 4, i + 1);
+	}
+
+	srduk_write_file(ctx, outname, b, total);
 }
 
 static duk_ret_t pmain (duk_context *ctx) {
@@ -77,8 +459,19 @@ static duk_ret_t pmain (duk_context *ctx) {
 
 	srduk_push_argv(ctx, argc, argv);
 	// register any user libraries/functions here
-	srduk_load_script(ctx, argv[0]);
+	if (srduk_load_script(ctx, argv[0])) return 0;
+
+	/* a plain srduk (nothing glued) can compile programs */
+	if (argc>=4 && strcmp(argv[1],"-c")==0) {
+		srduk_compile(ctx, argv[2], argv[3], argc>4 && strcmp(argv[4],"-z")==0);
+		return 0;
+	}
+	if (argc>=4 && strcmp(argv[1],"-a")==0) {
+		srduk_bundle(ctx, argv[2], argv[3], argc>4 && strcmp(argv[4],"-s")==0);
+		return 0;
+	}
 
+	duk_error(ctx,DUK_ERR_INTERNAL_ERROR,"no Duktape program found in %s (use -c prog.js prog.bc [-z] or -a dir prog.bundle [-s] to create one)",argv[0]);
 	return 0;
 }
 
@@ -91,11 +484,14 @@ static void fatal(const char* progname, const char* message)
 int main(int argc, char const *argv[]) {
 	
 	duk_context *ctx;
+	dukalloc_options alloc_opts;
 
 	getprogname();
 	if (argv[0]==NULL) fatal("srduk","cannot locate this executable");
 
-	ctx = duk_create_heap_default();
+	/* the arguments belong to the embedded program, so only the environment selects the allocator */
+	dukalloc_parse_options(&alloc_opts, NULL, NULL);
+	ctx = dukalloc_create_heap(&alloc_opts, NULL);
 	if (ctx==NULL) fatal(argv[0],"failed to create duktape heap");
 
 	duk_push_c_function(ctx, pmain, 2);
@@ -103,7 +499,7 @@ int main(int argc, char const *argv[]) {
 	duk_push_pointer(ctx, argv);
 	if (duk_pcall(ctx, 2) != DUK_EXEC_SUCCESS) fatal(argv[0],duk_to_string(ctx, -1));
 
-	duk_destroy_heap(ctx);
+	dukalloc_destroy_heap(ctx);
 
 	return EXIT_SUCCESS;
 }
\ No newline at end of file